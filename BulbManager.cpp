@@ -5,10 +5,17 @@
 
 #include "BulbManager.h"                   // Bulb manager
 #include <EEPROM.h>                        // EEPROM support
+#include <algorithm>                       // std::find_if
+#include <coredecls.h>                     // crc32()
 #include "MySystem.h"                      // System-level definitions
 
 using namespace ds;
 
+// Timer actions (see timer.cpp)
+extern void registerTimerActions();        // Register fixed timer actions
+extern void timerRestore(const Timer*, const int32_t); // Timer action: restore snapshot
+extern void timerScene(const Timer*, const int32_t);   // Timer action: activate scene
+
 // Destructor
 BulbManager::~BulbManager() {
   for (auto bulb : bulbs)
@@ -28,29 +35,172 @@ YBulb* BulbManager::find(const YBulb& bulb) const {
   return find(bulb.getID());
 }
 
+const char *BulbManager::GROUPS_CFG_NAME PROGMEM = "/groups.cfg";   // Groups and scenes configuration file
+const char *BulbManager::SNAPSHOT_DIR PROGMEM = "/snapshots";      // Snapshots folder
+const char *BulbManager::RULES_CFG_NAME PROGMEM = "rules.cfg";     // Rules configuration file (in system folder)
+
+// Bulb kept in RTC memory across warm resets
+struct RTCBulb {
+  uint64_t id;                             // Bulb ID (Yeelight IDs are 64-bit numbers in hex)
+  uint32_t ip;                             // IP-address
+  uint32_t support;                        // Supported methods (bitmask of ymethod_t)
+  uint16_t port;                           // Port
+  uint8_t power;                           // Power state (1 = "on")
+  uint8_t reserved;                        // Reserved
+  char model[12];                          // Model (null-terminated)
+};
+
+static const uint32_t RTCMEM_BULBS_MAGIC = 0x4C424259;  // "YBBL"
+static const uint8_t RTCMEM_BULBS_MAX = 10;             // Maximum number of bulbs kept in RTC memory
+
+// Bulb list kept in RTC memory across warm resets
+struct RTCBulbs {
+  uint32_t magic;                          // Bulb list signature
+  uint32_t num;                            // Number of bulbs
+  RTCBulb bulbs[RTCMEM_BULBS_MAX];         // Bulbs
+  uint32_t crc;                            // Checksum of the above
+};
+static_assert(sizeof(RTCBulbs) % sizeof(uint32_t) == 0 && sizeof(RTCBulbs) <= (DS_RTCMEM_SLOTS - DS_RTCMEM_SLOT_APP) * sizeof(uint32_t),
+  "Bulb list does not fit in RTC memory");
+
 // Start operation
+//// After a warm reset, bulbs are recovered from RTC memory, which saves waiting for discovery replies
 void BulbManager::begin() {
-  discover();
+  if (!System::isWarmStart() || !loadRTC())
+    discover();
   load();
+  loadGroups();
+  loadRules();
 
   // Register supported timer actions
-  System::timer_actions.push_front("light toggle");
-  System::timer_actions.push_front("light off");
-  System::timer_actions.push_front("light on");
+  registerTimerActions();
+  for (const auto& name : getSnapshots()) {
+    String action(F("restore "));
+    const auto prefix = action.length();
+    action += name;
+    System::addTimerAction(action, timerRestore, prefix);
+  }
+  for (const auto& scene : scenes) {
+    String action(F("scene "));
+    const auto prefix = action.length();
+    action += scene.name;
+    System::addTimerAction(action, timerScene, prefix);
+  }
+}
+
+// Background processing (state refresh)
+//// All active bulbs are asked for their state at once and the replies are collected as they come.
+//// Refresh interval doubles each time nothing has changed, and falls back to minimum after a change
+void BulbManager::update() {
+
+  // Keep the bulb list in RTC memory up to date
+  if (System::newSecond())
+    storeRTC();
+
+  // Delayed offs for bulbs without own timer (one per pass)
+  for (auto it = local_offs.begin(); it != local_offs.end(); ++it)
+    if ((long)(millis() - it->second) >= 0) {
+      const auto group = it->first;
+      local_offs.erase(it);            // The rest is looked at on the next pass
+      processEvent(EVENT_OFF, "Delayed off", group);
+      break;
+    }
+
+  // Continue dimming
+  if (dim_step && millis() - t_dim >= DIM_INTERVAL)
+    stepDimming();
+
+  // Send light adjustments. Only the latest request is sent, at most once per interval
+  if (light_pending && millis() - t_light >= LIGHT_INTERVAL)
+    applyLight();
+
+  // Send commands delayed by the bulb quota
+  for (const auto bulb : bulbs)
+    if (bulb->isThrottled() && !bulb->update())
+      System::log->printf(TIMED("Bulb %s delayed commands sent; commands: %s\n"), bulb->getID().c_str(), bulb->getQuotaStr().c_str());
+
+  auto refreshing = false;
+  for (size_t i = 0; i < bulbs.size(); i++) {
+    const auto bulb = bulbs[i];
+    if (bulb->isRefreshing()) {
+      const auto old_power = bulb->getPower();
+      auto changed = false;
+      refreshing |= bulb->receiveState(changed);
+      if (changed) {
+        refresh_changed = true;
+        System::log->printf(TIMED("Bulb %s state changed: power %s, light %s\n"), bulb->getID().c_str(),
+          bulb->getPowerStr().c_str(), bulb->getLightStr().c_str());
+      }
+
+      // Bulb back online; catch up with what was missed
+      if (!bulb->isRefreshing() && bulb->isReachable() && bulb->hasIntent()) {
+        const auto ok = bulb->replay();
+        System::log->printf(TIMED("Bulb %s is reachable again; missed power state %s\n"), bulb->getID().c_str(),
+          ok ? "applied" : "could not be applied");
+        refresh_changed = true;
+      }
+
+      if (bulb->getPower() != old_power)
+        processRules(i, bulb->getPower());
+    }
+  }
+  if (refreshing)
+    return;
+
+  if (t_refresh && refresh_changed) {
+    refresh_changed = false;
+    refreshSoon();
+  }
+
+  if ((!isLinked() && groups.empty()) || !System::networkIsConnected() || millis() - t_refresh < refresh_interval)
+    return;
+
+  // Start new refresh round
+  if (t_refresh && refresh_interval < REFRESH_INTERVAL_MAX)
+    refresh_interval = refresh_interval * 2 < REFRESH_INTERVAL_MAX ? refresh_interval * 2 : REFRESH_INTERVAL_MAX;
+  t_refresh = millis();
+  for (const auto bulb : bulbs) {
+    auto controlled = bulb->isActive();
+    for (const auto& group : groups)
+      controlled |= isSelected(bulb, &group);
+    if (controlled)
+      bulb->requestState();
+  }
+}
+
+// Schedule bulb state refresh at the fastest rate
+void BulbManager::refreshSoon() {
+  refresh_interval = REFRESH_INTERVAL_MIN;
+  t_refresh = millis();
 }
 
 // Process external event
-void BulbManager::processEvent(event_t event, const String& reason = "") {
+void BulbManager::processEvent(event_t event, const String& reason, const String& target) {
   const unsigned long BLINK_DELAY = 100;    // (ms)
   const unsigned long GLOW_DELAY = 1000;    // (ms)
 
+  // Resolve the target
+  const Group *group = nullptr;
+  const Scene *scene = nullptr;
+  if (!target.isEmpty() || event == EVENT_SCENE) {    // A scene must always be named
+    if (event == EVENT_SCENE)
+      scene = findScene(target);
+    else
+      group = findGroup(target);
+    if (!scene && !group) {
+      System::log->printf(TIMED("%s \"%s\" not found\n"), event == EVENT_SCENE ? "Scene" : "Group", target.c_str());
+      System::led.Blink(BLINK_DELAY, BLINK_DELAY * 2).Repeat(2);    // 2 blinks
+      return;
+    }
+  }
+
   // LED diagnostics:
   // 1 blink  - light flip OK
   // 1 + 2 blinks - one of the bulbs did not respond
   // 2 blinks - button not linked to bulbs
   // 1 glowing - Wi-Fi disconnected
   if (System::networkIsConnected()) {
-    if (isLinked()) {
+    if (isLinked() || group || scene) {
 
       // Flipping may block, causing JLED-style blink not being properly processed. Hence, force sequential processing (first blink, then flip)
       // To make JLED working smoothly in this case, an asynchronous WiFiClient.connect() method would be needed
@@ -61,32 +211,40 @@ void BulbManager::processEvent(event_t event, const String& reason = "") {
       System::led.Off().Update();
 
       String msg(reason);
-      msg += reason.isEmpty() ? "Bulbs are" : "; bulbs are ";
-      const auto bulbs_on = isOn();
-      switch (event) {
-        case EVENT_ON:   msg += bulbs_on ? "already ON"  : "going to ON"; break;
-        case EVENT_OFF:  msg += bulbs_on ? "going to OFF": "already OFF"; break;
-        case EVENT_FLIP: msg += bulbs_on ? "going to OFF": "going to ON"; break;
+      if (scene) {
+        msg += reason.isEmpty() ? "Activating" : "; activating";
+        msg += " scene \"";
+        msg += target;
+        msg += '"';
+      } else {
+        if (group) {
+          msg += reason.isEmpty() ? "Group \"" : "; group \"";
+          msg += target;
+          msg += "\" bulbs are ";
+        } else
+          msg += reason.isEmpty() ? "Bulbs are " : "; bulbs are ";
+        const auto bulbs_on = isOn(group);
+        const auto bulbs_discordant = isDiscordant(group);
+        switch (event) {
+          case EVENT_ON:   msg += bulbs_on && !bulbs_discordant ? "already ON"  : "going to ON"; break;
+          case EVENT_OFF:  msg += bulbs_on || bulbs_discordant  ? "going to OFF": "already OFF"; break;
+          case EVENT_FLIP: msg += bulbs_on ? "going to OFF": "going to ON"; break;
+          default: ;
+        }
+        if (bulbs_discordant)
+          msg += " (reconciling discordant bulbs)";
       }
       System::appLogWriteLn(msg, true);
 
+      // Bulbs already in the target state are left alone, so there is no need to check the state here
       auto action_ok = false;
       switch (event) {
-
-        case EVENT_ON:
-          if (!bulbs_on)
-            action_ok = turnOn();
-          break;
-
-        case EVENT_OFF:
-          if (bulbs_on)
-            action_ok = turnOff();
-          break;
-
-        case EVENT_FLIP:
-          action_ok = flip();
-          break;
+        case EVENT_ON:    action_ok = turnOn(group);         break;
+        case EVENT_OFF:   action_ok = turnOff(group);        break;
+        case EVENT_FLIP:  action_ok = flip(group);           break;
+        case EVENT_SCENE: action_ok = activateScene(*scene); break;
       }
+      refreshSoon();    // Follow up on the outcome
       if (!action_ok)
 
         // Some bulbs did not respond
@@ -111,14 +269,17 @@ void BulbManager::processEvent(event_t event, const String& reason = "") {
 void BulbManager::load() {
 
   // Load settings from EEPROM
-  EEPROM.begin(4);
-  if (EEPROM.read(0) == 'Y' && EEPROM.read(1) == 'B' && EEPROM.read(2) == EEPROM_FORMAT_VERSION) {
+  EEPROM.begin(5);
+  const auto format_version = EEPROM.read(2);
+  if (EEPROM.read(0) == 'Y' && EEPROM.read(1) == 'B' && (format_version == EEPROM_FORMAT_VERSION || format_version == EEPROM_FORMAT_VERSION_V1)) {
     char bulbid_c[YBulb::ID_LENGTH + 1] = {0,};
     const uint8_t n = EEPROM.read(3);
+    unsigned int eeprom_addr = 4;
+    if (format_version == EEPROM_FORMAT_VERSION)
+      setPolicy((policy_t)EEPROM.read(eeprom_addr++));
     System::log->printf(TIMED("Found %d bulb%s configuration in EEPROM\n"), n, n == 1 ? "" : "s");
     EEPROM.end();
-    EEPROM.begin(2 + 1 + 1 + (YBulb::ID_LENGTH + 1) * n);
-    unsigned int eeprom_addr = 4;
+    EEPROM.begin(eeprom_addr + (YBulb::ID_LENGTH + 1) * n);
     for (uint8_t i = 0; i < n; i++) {
       EEPROM.get(eeprom_addr, bulbid_c);
       eeprom_addr += sizeof(bulbid_c);
@@ -145,19 +306,27 @@ void BulbManager::load() {
 //   0-1: 'YB' - Yeelight Bulb configuration marker
 //     2: format version. Increment each time the format changes
 //     3: number of stored bulbs
-//  4-22: <selected bulb ID> (19 characters, null-terminated)
+//     4: group state rule (policy_t). Absent in format 49
+//  5-23: <selected bulb ID> (19 characters, null-terminated)
 //      : ...
 void BulbManager::save() {
-  const unsigned int nargs = System::web_server.args();
-  const size_t used_eeprom_size = 2 + 1 + 1 + (YBulb::ID_LENGTH + 1) * nargs;   // TODO: maybe put some constraint on nargs (externally provided parameter)
+  unsigned int nargs = 0;
+  for (unsigned int i = 0; i < (unsigned int)System::web_server.args(); i++)
+    if (System::web_server.argName(i) == "bulb")
+      nargs++;
+  const size_t used_eeprom_size = 2 + 1 + 1 + 1 + (YBulb::ID_LENGTH + 1) * nargs;   // TODO: maybe put some constraint on nargs (externally provided parameter)
   EEPROM.begin(used_eeprom_size);
-  unsigned int eeprom_addr = 4;
+  unsigned int eeprom_addr = 5;
 
   deactivateAll();
+  if (System::web_server.hasArg("policy"))
+    setPolicy((policy_t)System::web_server.arg("policy").toInt());
 
   if(nargs) {
-    for(unsigned int i = 0; i < nargs; i++) {
-      const unsigned int n = System::web_server.arg(i).c_str()[0] - '0';
+    for(unsigned int i = 0; i < (unsigned int)System::web_server.args(); i++) {
+      if (System::web_server.argName(i) != "bulb")
+        continue;
+      const unsigned int n = System::web_server.arg(i).toInt();
       if (n < bulbs.size()) {
         const auto bulb = bulbs[n];
         char bulbid_c[YBulb::ID_LENGTH + 1] = {0,};
@@ -177,6 +346,7 @@ void BulbManager::save() {
       EEPROM.write(1, 'B');
       EEPROM.write(2, EEPROM_FORMAT_VERSION);
       EEPROM.write(3, nabulbs);
+      EEPROM.write(4, policy);
       System::log->printf(TIMED("%d bulb%s stored in EEPROM, using %u byte(s)\n"), nabulbs, nabulbs == 1 ? "" : "s", eeprom_addr);
     } else
       System::log->printf(TIMED("No bulbs were stored in EEPROM\n"));
@@ -213,41 +383,138 @@ uint8_t BulbManager::discover() {
       delete discovered_bulb;
     } else {
       bulbs.push_back(discovered_bulb);
-      System::log->printf(TIMED("Registered bulb id: %s, name: %s, model: %s, power: %s\n"),
+      System::log->printf(TIMED("Registered bulb id: %s, name: %s, model: %s, power: %s, light: %s, support: 0x%06x\n"),
         discovered_bulb->getID().c_str(), discovered_bulb->getName().c_str(),
-        discovered_bulb->getModel().c_str(), discovered_bulb->getPowerStr().c_str());
+        discovered_bulb->getModel().c_str(), discovered_bulb->getPowerStr().c_str(),
+        discovered_bulb->getLightStr().c_str(), discovered_bulb->getSupport());
     }
   }
   
   System::log->printf(TIMED("Total bulbs discovered: %d\n"), bulbs.size());
+  compileRules();
   return bulbs.size();
 }
 
+// Recover bulb list from RTC memory after a warm reset. Returns true on success
+//// Light state is not kept; the first state refresh brings it
+bool BulbManager::loadRTC() {
+  RTCBulbs rtc_bulbs;
+  if (!System::getRTCMem(reinterpret_cast<uint32_t *>(&rtc_bulbs), DS_RTCMEM_SLOT_APP, sizeof(rtc_bulbs) / sizeof(uint32_t))
+    || rtc_bulbs.magic != RTCMEM_BULBS_MAGIC || rtc_bulbs.crc != crc32(&rtc_bulbs, offsetof(RTCBulbs, crc))
+    || !rtc_bulbs.num || rtc_bulbs.num > RTCMEM_BULBS_MAX)
+    return false;
+
+  for (uint8_t i = 0; i < rtc_bulbs.num; i++) {
+    const auto& rtc_bulb = rtc_bulbs.bulbs[i];
+    char id[YBulb::ID_LENGTH + 1];
+    snprintf(id, sizeof(id), "0x%016llx", (unsigned long long)rtc_bulb.id);
+    const auto bulb = new YBulb(id, IPAddress(rtc_bulb.ip), rtc_bulb.port);
+    bulb->setModel(rtc_bulb.model);
+    bulb->setPower(rtc_bulb.power != 0);
+    bulb->setSupport(rtc_bulb.support);
+    bulbs.push_back(bulb);
+  }
+  rtcmem_crc = rtc_bulbs.crc;
+  System::log->printf(TIMED("Recovered %d bulb(s) from RTC memory; skipping discovery\n"), bulbs.size());
+  compileRules();
+  return true;
+}
+
+// Store bulb list into RTC memory, if it has changed
+//// If the list does not fit, an invalid one is stored, so that a warm reset falls back to discovery
+void BulbManager::storeRTC() {
+  RTCBulbs rtc_bulbs;
+  memset(&rtc_bulbs, 0, sizeof(rtc_bulbs));  // Padding is covered by the checksum too
+  auto ok = bulbs.size() <= RTCMEM_BULBS_MAX;
+  for (size_t i = 0; ok && i < bulbs.size(); i++) {
+    const auto bulb = bulbs[i];
+    auto& rtc_bulb = rtc_bulbs.bulbs[i];
+    char id[YBulb::ID_LENGTH + 1];
+    rtc_bulb.id = strtoull(bulb->getID().c_str(), nullptr, 16);
+    snprintf(id, sizeof(id), "0x%016llx", (unsigned long long)rtc_bulb.id);
+    ok = bulb->getID() == id;      // Otherwise the ID cannot be restored from a number
+    rtc_bulb.ip = bulb->getIP();
+    rtc_bulb.support = bulb->getSupport();
+    rtc_bulb.port = bulb->getPort();
+    rtc_bulb.power = bulb->getPower();
+    strncpy(rtc_bulb.model, bulb->getModel().c_str(), sizeof(rtc_bulb.model) - 1);
+  }
+  if (ok) {
+    rtc_bulbs.magic = RTCMEM_BULBS_MAGIC;
+    rtc_bulbs.num = bulbs.size();
+  } else
+    memset(&rtc_bulbs, 0, sizeof(rtc_bulbs));
+  rtc_bulbs.crc = crc32(&rtc_bulbs, offsetof(RTCBulbs, crc));
+  if (rtc_bulbs.crc != rtcmem_crc
+    && System::setRTCMem(reinterpret_cast<const uint32_t *>(&rtc_bulbs), DS_RTCMEM_SLOT_APP, sizeof(rtc_bulbs) / sizeof(uint32_t)))
+    rtcmem_crc = rtc_bulbs.crc;
+}
+
 // Turn on bulbs. Returns true on full success
-bool BulbManager::turnOn() {
-  return isOn() ? true : flip();
+bool BulbManager::turnOn(const Group *group) {
+  return setPower(true, group);
 }
 
 // Turn off bulbs. Returns true on full success
-bool BulbManager::turnOff() {
-  return isOff() ? true : flip();
+bool BulbManager::turnOff(const Group *group) {
+  return setPower(false, group);
 }
 
 // Flip bulbs. Returns true on full success
-bool BulbManager::flip() {
+//// Group state is flipped; discordant bulbs are brought to the new group state
+bool BulbManager::flip(const Group *group) {
+  return setPower(!isOn(group), group);
+}
+
+// Bring bulbs to a given power state. Returns true on full success
+//// Only the bulbs differing from the target state are sent a command.
+//// To make bulbs switch simultaneously, commands are sent in two phases: first, all bulbs are connected to and sent all but the last bytes of a command;
+//// then the last bytes are sent to all of them in a tight loop. Slow connections thus do not delay switching. The skew between the first and the last bulb is logged
+bool BulbManager::setPower(const bool target, const Group *group) {
   auto ret = true;
-  if (isLinked()) {
-    for (const auto bulb : bulbs) {
-      if (bulb->isActive()) {
-        if (bulb->flip())
-          System::log->printf(TIMED("Bulb %s toggle sent\n"), bulb->getID().c_str());
+  if (isLinked() || group) {
+
+    // Arm
+    std::vector<YBulb *> armed;
+    std::vector<size_t> switching;        // Bulb numbers, for rules
+    for (size_t i = 0; i < bulbs.size(); i++) {
+      const auto bulb = bulbs[i];
+      if (!isSelected(bulb, group) || bulb->getPower() == target)
+        continue;
+      switching.push_back(i);
+      if (bulb->arm(target)) {
+        if (bulb->isArmed())
+          armed.push_back(bulb);
+        else
+          System::log->printf(TIMED("Bulb %s power %s delayed\n"), bulb->getID().c_str(), target ? "on" : "off");
+      } else {
+        System::log->printf(TIMED("Bulb connection to %s failed\n"), bulb->getIP().toString().c_str());
+        ret = false;
+        yield();        // Connection timeout is lenghty; allow for background processing (is this really needed?)
+      }
+    }
+
+    // Fire
+    if (!armed.empty()) {
+      for (const auto bulb : armed)
+        bulb->fire();
+      const auto skew = armed.back()->getFireTime() - armed.front()->getFireTime();
+      for (const auto bulb : armed) {
+        bulb->release();
+        if (bulb->getPower() == target)
+          System::log->printf(TIMED("Bulb %s power %s sent\n"), bulb->getID().c_str(), target ? "on" : "off");
         else {
           System::log->printf(TIMED("Bulb connection to %s failed\n"), bulb->getIP().toString().c_str());
           ret = false;
-          yield();        // Connection timeout is lenghty; allow for background processing (is this really needed?)
         }
       }
+      if (armed.size() > 1)
+        System::log->printf(TIMED("%u bulbs switched with %lu us skew\n"), armed.size(), skew);
     }
+
+    for (const auto i : switching)
+      if (bulbs[i]->getPower() == target)
+        processRules(i, target);
   } else {
     System::log->printf(TIMED("No linked bulbs found\n"));
     ret = false;
@@ -255,14 +522,929 @@ bool BulbManager::flip() {
   return ret;
 }
 
+// Return true if bulb is subject to control (group member or, by default, active)
+bool BulbManager::isSelected(const YBulb *bulb, const Group *group) const {
+  if (!group)
+    return bulb->isActive();
+  for (const auto& id : group->ids)
+    if (*bulb == id)
+      return true;
+  return false;
+}
+
 // Return true if lights are on
-bool BulbManager::isOn() const {
+//// If bulbs are in discordant states (issue #21), the group state is decided by the configured rule
+bool BulbManager::isOn(const Group *group) const {
+  uint8_t non = 0, noff = 0;
+  for (const auto bulb : bulbs)
+    if (isSelected(bulb, group)) {
+      if (policy == POLICY_LEADER)
+        return bulb->getPower();   // First bulb state is the group state
+      bulb->getPower() ? non++ : noff++;
+    }
+  return policy == POLICY_ANY_ON ? non : non > noff;
+}
 
-  // Ignore for now that bulbs could be in discordant states (issue #21). Treat first active bulb state as the global state
-  for (auto bulb : bulbs)
-    if (bulb->isActive())
-      return bulb->getPower();
-  return false;
+// Return true if bulbs are not in the same power state
+bool BulbManager::isDiscordant(const Group *group) const {
+  uint8_t non = 0, noff = 0;
+  for (const auto bulb : bulbs)
+    if (isSelected(bulb, group))
+      bulb->getPower() ? non++ : noff++;
+  return non && noff;
+}
+
+// Request light setting (YL_PROP_BRIGHT, YL_PROP_CT or YL_PROP_RGB) for a group (empty = active bulbs)
+//// Requests are coalesced: a new request overrides a pending one, so fast slider movements end up in a few commands
+void BulbManager::setLight(const yprop_t prop, const uint32_t value, const String& target) {
+  if (light_pending && light_group != target)
+    applyLight();     // Do not mix up targets
+  light_group = target;
+  switch (prop) {
+    case YL_PROP_BRIGHT: light_target.bright = constrain(value, 1U, 100U);  break;
+    case YL_PROP_CT:     light_target.ct = constrain(value, 1700U, 6500U);  light_pending &= ~(1 << YL_PROP_RGB); break;
+    case YL_PROP_RGB:    light_target.rgb = value & 0xffffff;               light_pending &= ~(1 << YL_PROP_CT);  break;
+    default: return;
+  }
+  light_pending |= 1 << prop;
+}
+
+// Send requested light settings to bulbs. Returns true on full success
+//// Transition lasts the interval between adjustments, so that a series of adjustments looks like a continuous change.
+//// Bulbs which are off are not touched (Yeelight refuses adjustments in this state)
+bool BulbManager::applyLight() {
+  auto ret = true;
+  const Group *group = nullptr;
+  if (!light_group.isEmpty()) {
+    group = findGroup(light_group);
+    if (!group)
+      light_pending = 0;
+  }
+
+  for (const auto bulb : bulbs) {
+    if (!light_pending)
+      break;
+    if (!isSelected(bulb, group) || !bulb->getPower())
+      continue;
+    auto ok = true;
+    if (light_pending & 1 << YL_PROP_BRIGHT && bulb->getBright() != light_target.bright)
+      ok &= bulb->setBright(light_target.bright, LIGHT_INTERVAL);
+    if (light_pending & 1 << YL_PROP_CT && (bulb->getCT() != light_target.ct || bulb->getColorMode() != YL_MODE_CT))
+      ok &= bulb->setCT(light_target.ct, LIGHT_INTERVAL);
+    if (light_pending & 1 << YL_PROP_RGB && (bulb->getRGB() != light_target.rgb || bulb->getColorMode() != YL_MODE_RGB))
+      ok &= bulb->setRGB(light_target.rgb, LIGHT_INTERVAL);
+    if (ok)
+      System::log->printf(TIMED("Bulb %s light adjusted to %s\n"), bulb->getID().c_str(), bulb->getLightStr().c_str());
+    else {
+      System::log->printf(TIMED("Bulb %s light adjustment failed\n"), bulb->getID().c_str());
+      ret = false;
+    }
+  }
+  light_pending = 0;
+  t_light = millis();
+  refreshSoon();
+  return ret;
+}
+
+// Start changing brightness of active bulbs (direction alternates between calls)
+//// Bulbs which are off are turned on at the lowest brightness. The first step is sent on the next update() call
+void BulbManager::startDimming() {
+  const auto leader = getLeader();
+  if (!leader || !System::networkIsConnected())
+    return;
+
+  dim_level = leader->getBright();
+  if (!isOn()) {
+    for (const auto bulb : bulbs)
+      if (isSelected(bulb) && !bulb->getPower() && bulb->setPowerState(true))
+        bulb->setBright(1);
+    dim_level = 1;
+    dim_up = true;
+  } else
+    dim_up = dim_level <= 1 ? true : dim_level >= 100 ? false : !dim_up;
+  dim_step = dim_up ? DIM_STEP : -DIM_STEP;
+  t_dim = millis() - DIM_INTERVAL;
+}
+
+// Stop changing brightness
+void BulbManager::stopDimming(const String& reason) {
+  if (!dim_step)
+    return;
+
+  dim_step = 0;
+  String msg(reason);
+  msg += reason.isEmpty() ? "Brightness set to " : "; brightness set to ";
+  msg += dim_level;
+  msg += '%';
+  System::appLogWriteLn(msg, true);
+  refreshSoon();
+}
+
+// Send the next dimming step to bulbs
+//// Steps go through the bulb command quota with coalescing, so a long hold cannot overflow the bulbs
+void BulbManager::stepDimming() {
+  t_dim = millis();
+  const int8_t new_level = constrain(dim_level + dim_step, 1, 100);
+  if (new_level == dim_level)
+    return;       // Limit reached; wait for release
+
+  dim_level = new_level;
+  for (const auto bulb : bulbs)
+    if (isSelected(bulb) && bulb->getPower() && !bulb->setBright(dim_level, DIM_INTERVAL))
+      System::log->printf(TIMED("Bulb %s brightness adjustment failed\n"), bulb->getID().c_str());
+}
+
+// Return the first controlled bulb, if any
+const YBulb *BulbManager::getLeader(const Group *group) const {
+  for (const auto bulb : bulbs)
+    if (isSelected(bulb, group))
+      return bulb;
+  return nullptr;
+}
+
+// Find a group by name
+const BulbManager::Group *BulbManager::findGroup(const String& name) const {
+  for (const auto& group : groups)
+    if (group.name == name)
+      return &group;
+  return nullptr;
+}
+
+// Find a scene by name
+const BulbManager::Scene *BulbManager::findScene(const String& name) const {
+  for (const auto& scene : scenes)
+    if (scene.name == name)
+      return &scene;
+  return nullptr;
+}
+
+// Send scene settings to bulbs. Returns true on full success
+//// Messages are prepared in advance, so activation is just a matter of sending them
+bool BulbManager::activateScene(const Scene& scene) {
+  const auto old_powers = getPowers();
+  auto ret = !scene.frames.empty();
+  for (const auto& frame : scene.frames) {
+    const auto bulb = find(frame.first);
+    if (bulb && bulb->send(frame.second)) {
+      bulb->setPower(scene.power);
+      System::log->printf(TIMED("Bulb %s scene \"%s\" sent\n"), bulb->getID().c_str(), scene.name.c_str());
+    } else {
+      System::log->printf(TIMED("Bulb %s is not reachable\n"), frame.first.c_str());
+      ret = false;
+      yield();
+    }
+  }
+  processRules(old_powers);
+  return ret;
+}
+
+// Prepare scene command messages
+//// Messages are tailored to each bulb's capabilities (if the bulb is known at the moment)
+void BulbManager::compileScene(Scene& scene) const {
+  static const uint16_t SCENE_TRANSITION = 500; // Transition duration of scene activation (ms)
+
+  scene.frames.clear();
+  const auto group = findGroup(scene.group);
+  if (!group)
+    return;
+
+  for (const auto& id : group->ids) {
+    const auto bulb = find(id);
+    String frame;
+    if (scene.ramp)
+      frame = rampMessage(bulb, scene.ramp, scene.power, scene.bright ? scene.bright : 100, scene.ct);
+    else
+    if (!scene.power)
+      frame = YBulb::message(YL_METHOD_SET_POWER, String(F("\"off\"")) + YBulb::transition(SCENE_TRANSITION));
+    else
+    if (scene.ct && (!bulb || bulb->supports(YL_METHOD_SET_SCENE))) {
+
+      // Power, color temperature and brightness in one go
+      String params(F("\"ct\","));
+      params += scene.ct;
+      params += ',';
+      params += scene.bright ? scene.bright : 100;
+      frame = YBulb::message(YL_METHOD_SET_SCENE, params);
+    } else {
+      frame = YBulb::message(YL_METHOD_SET_POWER, String(F("\"on\"")) + YBulb::transition(SCENE_TRANSITION));
+      if (scene.bright && (!bulb || bulb->supports(YL_METHOD_SET_BRIGHT))) {
+        String params;
+        params += scene.bright;
+        params += YBulb::transition(SCENE_TRANSITION);
+        frame += YBulb::message(YL_METHOD_SET_BRIGHT, params);
+      }
+      if (scene.ct && bulb && bulb->supports(YL_METHOD_SET_CT_ABX)) {
+        String params;
+        params += scene.ct;
+        params += YBulb::transition(SCENE_TRANSITION);
+        frame += YBulb::message(YL_METHOD_SET_CT_ABX, params);
+      }
+    }
+    scene.frames.emplace_back(id, frame);
+  }
+}
+
+// Compose bulb command messages for a long transition (bulb, duration in min, power, brightness in %, color temperature in K or 0 to keep)
+//// The transition is compiled into a single color flow run by the bulb itself, so the switch stays idle meanwhile.
+//// Turning on starts from the lowest brightness ("set_scene" can do it in one go, even if the bulb is off); turning off fades down to the lowest brightness first
+String BulbManager::rampMessage(const YBulb *bulb, const uint8_t minutes, const bool power, const uint8_t bright, const uint16_t ct) {
+  static const uint16_t CT_DEFAULT = 4000;      // Color temperature to use if the bulb's one is unknown (K)
+
+  const auto duration = minutes * 60000UL;
+  const auto flow_ct = ct ? ct : bulb && bulb->getCT() ? bulb->getCT() : CT_DEFAULT;
+  if (!power)
+    return YBulb::message(YL_METHOD_START_CF, YBulb::ramp(duration, 1, flow_ct, YL_FLOW_OFF));
+  if (!bulb || bulb->supports(YL_METHOD_SET_SCENE))
+    return YBulb::message(YL_METHOD_SET_SCENE, String(F("\"cf\",")) + YBulb::ramp(duration, bright, flow_ct, YL_FLOW_STAY, true));
+  return YBulb::message(YL_METHOD_SET_POWER, F("\"on\"")) + YBulb::message(YL_METHOD_START_CF, YBulb::ramp(duration, bright, flow_ct, YL_FLOW_STAY, true));
+}
+
+// Turn bulbs off in a given number of minutes (0 = cancel; at most 24 h). Returns true on full success
+//// Bulbs supporting it are programmed with their own timer, which needs no further attention from the switch and survives its reboot.
+//// Other bulbs fall back to a local timer (the whole group is then turned off by the switch; this is harmless for bulbs already off)
+bool BulbManager::delayOff(const uint16_t minutes, const String& reason, const String& target) {
+  const uint16_t MINUTES_MAX = 24 * 60;     // Longest delay (keeps the local timer well within millis() range)
+
+  if (minutes > MINUTES_MAX) {
+    System::log->printf(TIMED("Delayed off in %u min rejected (maximum is %u min)\n"), minutes, MINUTES_MAX);
+    return false;
+  }
+  const Group *group = nullptr;
+  if (!target.isEmpty()) {
+    group = findGroup(target);
+    if (!group) {
+      System::log->printf(TIMED("Group \"%s\" not found\n"), target.c_str());
+      return false;
+    }
+  }
+
+  String msg(reason);
+  msg += reason.isEmpty() ? "" : "; ";
+  msg += group ? "group \"" + target + "\" bulbs" : String(F("bulbs"));
+  if (minutes) {
+    msg += F(" are going to OFF in ");
+    msg += minutes;
+    msg += F(" min");
+  } else
+    msg += F(" delayed off cancelled");
+  System::appLogWriteLn(msg, true);
+
+  auto ret = true;
+  auto local = false;
+  for (const auto bulb : bulbs) {
+    if (!isSelected(bulb, group))
+      continue;
+    if (bulb->supports(YL_METHOD_CRON_ADD) && bulb->setOffTimer(minutes))
+      System::log->printf(TIMED("Bulb %s off timer set to %u min\n"), bulb->getID().c_str(), minutes);
+    else
+    if (bulb->supports(YL_METHOD_CRON_ADD) && minutes) {
+      System::log->printf(TIMED("Bulb %s is not reachable\n"), bulb->getID().c_str());
+      ret = false;
+      local = true;
+    } else
+      local = true;
+  }
+  // Each group has its own local timer, so that delayed offs of different groups do not cancel each other
+  const auto local_off = std::find_if(local_offs.begin(), local_offs.end(),
+    [&target](const std::pair<String, unsigned long>& off) { return off.first == target; });
+  if (local && minutes) {
+    const auto t_off = millis() + minutes * 60000UL;
+    if (local_off != local_offs.end())
+      local_off->second = t_off;
+    else
+      local_offs.emplace_back(target, t_off);
+    System::log->printf(TIMED("Local off timer set to %u min\n"), minutes);
+  } else
+  if (local_off != local_offs.end())
+    local_offs.erase(local_off);
+  return ret;
+}
+
+// Start a long transition (min) to a power state, brightness (%) and color temperature (K; 0 = keep). Returns true on full success
+//// Bulbs already off are not faded out
+bool BulbManager::startRamp(const uint8_t minutes, const bool power, const uint8_t bright, const uint16_t ct, const Group *group) {
+  const auto old_powers = getPowers();
+  auto ret = true;
+  for (const auto bulb : bulbs) {
+    if (!isSelected(bulb, group) || (!power && !bulb->getPower()))
+      continue;
+    if (bulb->send(rampMessage(bulb, minutes, power, bright, ct))) {
+      bulb->setPower(true);     // Until the flow ends
+      System::log->printf(TIMED("Bulb %s %u min transition started\n"), bulb->getID().c_str(), minutes);
+    } else {
+      System::log->printf(TIMED("Bulb %s is not reachable\n"), bulb->getID().c_str());
+      ret = false;
+      yield();
+    }
+  }
+  processRules(old_powers);
+  refreshSoon();
+  return ret;
+}
+
+// Load groups and scenes configuration
+// File format (one record per line, fields separated by tabs):
+//   G <name> <bulb ID> [<bulb ID> ...]                - group (IDs separated by spaces)
+//   S <name> <group> <power> <brightness> <CT> [<ramp>] - scene (ramp in minutes; absent in older files)
+//   F <bulb ID> <message>                             - scene message for a bulb (follows its scene)
+void BulbManager::loadGroups() {
+  groups.clear();
+  scenes.clear();
+  auto cfg_file = System::fs.open(GROUPS_CFG_NAME, "r");
+  if (!cfg_file) {
+    System::log->printf(TIMED("No groups configured\n"));
+    return;
+  }
+
+  while (cfg_file.available()) {
+    auto line = cfg_file.readStringUntil('\n');
+    if (line.length() < 3 || line[1] != '\t')
+      continue;
+    const auto type = line[0];
+    line.remove(0, 2);
+    auto sep = line.indexOf('\t');
+    if (sep == -1)
+      continue;
+
+    switch (type) {
+
+      case 'G': {
+        Group group;
+        group.name = line.substring(0, sep);
+        line.remove(0, sep + 1);
+        while (line.length()) {
+          sep = line.indexOf(' ');
+          group.ids.push_back(line.substring(0, sep == -1 ? line.length() : sep));
+          line.remove(0, sep == -1 ? line.length() : sep + 1);
+        }
+        groups.push_back(group);
+        break;
+      }
+
+      case 'S': {
+        Scene scene;
+        scene.name = line.substring(0, sep);
+        line.remove(0, sep + 1);
+        sep = line.indexOf('\t');
+        scene.group = line.substring(0, sep);
+        line.remove(0, sep + 1);
+        scene.power = line.toInt();
+        line.remove(0, line.indexOf('\t') + 1);
+        scene.bright = line.toInt();
+        line.remove(0, line.indexOf('\t') + 1);
+        scene.ct = line.toInt();
+        sep = line.indexOf('\t');
+        scene.ramp = sep == -1 ? 0 : line.substring(sep + 1).toInt();
+        scenes.push_back(scene);
+        break;
+      }
+
+      case 'F': {
+        if (scenes.empty())
+          break;
+        auto& frames = scenes.back().frames;
+        const auto id = line.substring(0, sep);
+        line.remove(0, sep + 1);
+        line += F("\r\n");
+        if (!frames.empty() && frames.back().first == id)
+          frames.back().second += line;   // Several messages for the same bulb
+        else
+          frames.emplace_back(id, line);
+        break;
+      }
+
+      default: ;
+    }
+  }
+  cfg_file.close();
+  System::log->printf(TIMED("Loaded %u group(s) and %u scene(s)\n"), groups.size(), scenes.size());
+}
+
+// Store groups and scenes configuration. Returns true on success
+bool BulbManager::storeGroups() const {
+  auto cfg_file = System::fs.open(GROUPS_CFG_NAME, "w");
+  if (!cfg_file)
+    return false;
+
+  String cfg;
+  for (const auto& group : groups) {
+    cfg += F("G\t");
+    cfg += group.name;
+    cfg += '\t';
+    for (const auto& id : group.ids) {
+      cfg += id;
+      cfg += ' ';
+    }
+    cfg.trim();
+    cfg += '\n';
+  }
+  for (const auto& scene : scenes) {
+    cfg += F("S\t");
+    cfg += scene.name;
+    cfg += '\t';
+    cfg += scene.group;
+    cfg += '\t';
+    cfg += scene.power;
+    cfg += '\t';
+    cfg += scene.bright;
+    cfg += '\t';
+    cfg += scene.ct;
+    cfg += '\t';
+    cfg += scene.ramp;
+    cfg += '\n';
+    for (const auto& frame : scene.frames) {
+      int start = 0;
+      int end;
+      while ((end = frame.second.indexOf(F("\r\n"), start)) != -1) {
+        cfg += F("F\t");
+        cfg += frame.first;
+        cfg += '\t';
+        cfg += frame.second.substring(start, end);
+        cfg += '\n';
+        start = end + 2;
+      }
+    }
+  }
+  const auto ret = cfg_file.print(cfg) == cfg.length();
+  cfg_file.close();
+  return ret;
+}
+
+// Return true if a string is usable as a group, scene, snapshot or macro name (names end up in configuration file, web links and timer scripting)
+//// The length leaves room for the longest timer action prefix ("restore "). Characters with a meaning in URL queries or script strings are excluded,
+//// so that names only need spaces encoded in links
+bool BulbManager::isValidName(const String& name) {
+  if (name.isEmpty() || name.length() > TIMER_ACTION_NAME_MAX - (sizeof("restore ") - 1))
+    return false;
+  static const char INVALID_CHARS[] = "\t'\"</&#+%\\";
+  for (uint8_t i = 0; i < sizeof(INVALID_CHARS) - 1; i++)
+    if (name.indexOf(INVALID_CHARS[i]) != -1)
+      return false;
+  return true;
+}
+
+// Return a name for use as a URL query value
+String BulbManager::urlName(const String& name) {
+  String url_name(name);
+  url_name.replace(F(" "), F("%20"));
+  return url_name;
+}
+
+// Save new groups and scenes configuration. Returns true on success
+//// Web arguments: "del=<name>" to delete a group or a scene;
+//// "group=<name>&bulb=<n>&bulb=<m>..." to define a group;
+//// "scene=<name>&of=<group>&power=<0|1>&bright=<%>&ct=<K>&ramp=<min>" to define a scene;
+//// "snapshot=<name>" to save current state of linked bulbs; "delsnap=<name>" to delete it;
+//// "rule&src=<n>&ev=<0|1>&when=<rule_when_t>&dst=<m>&act=<-1..100>" to add a rule; "delrule=<number>" to delete it
+bool BulbManager::saveGroups() {
+  auto& web_server = System::web_server;
+
+  if (web_server.hasArg("snapshot")) {
+    auto name = web_server.arg("snapshot");
+    name.trim();
+    return saveSnapshot(name);
+  } else
+
+  if (web_server.hasArg("delsnap"))
+    return deleteSnapshot(web_server.arg("delsnap"));
+  else
+
+  if (web_server.hasArg("rule")) {
+    Rule rule;
+    const unsigned int trigger = web_server.arg("src").toInt();
+    const unsigned int target = web_server.arg("dst").toInt();
+    if (trigger >= bulbs.size() || target >= bulbs.size() || trigger == target || rules.size() >= RULES_MAX)
+      return false;
+    rule.trigger = bulbs[trigger]->getID();
+    rule.on = web_server.arg("ev").toInt();
+    rule.when = web_server.arg("when").toInt();
+    if (rule.when >= RULE_INVALID)
+      return false;
+    rule.target = bulbs[target]->getID();
+    rule.action = constrain(web_server.arg("act").toInt(), -1L, 100L);
+    rules.push_back(rule);
+    compileRules();
+    return storeRules();
+  } else
+
+  if (web_server.hasArg("delrule")) {
+    const unsigned int r = web_server.arg("delrule").toInt();
+    if (r >= rules.size())
+      return false;
+    rules.erase(rules.begin() + r);
+    compileRules();
+    return storeRules();
+  } else
+
+  if (web_server.hasArg("del")) {
+    const auto name = web_server.arg("del");
+    for (auto it = groups.begin(); it != groups.end(); ++it)
+      if (it->name == name) {
+        groups.erase(it);
+        break;
+      }
+    for (auto it = scenes.begin(); it != scenes.end(); ++it)
+      if (it->name == name) {
+        System::removeTimerAction(String(F("scene ")) + name);
+        scenes.erase(it);
+        break;
+      }
+  } else
+
+  if (web_server.hasArg("group")) {
+    Group group;
+    group.name = web_server.arg("group");
+    group.name.trim();
+    if (!isValidName(group.name) || findScene(group.name))
+      return false;
+    for (unsigned int i = 0; i < (unsigned int)web_server.args(); i++) {
+      if (web_server.argName(i) != "bulb")
+        continue;
+      const unsigned int n = web_server.arg(i).toInt();
+      if (n < bulbs.size())
+        group.ids.push_back(bulbs[n]->getID());
+    }
+    if (group.ids.empty())
+      return false;
+
+    auto existing_group = std::find_if(groups.begin(), groups.end(), [&](const Group& g) { return g.name == group.name; });
+    if (existing_group != groups.end())
+      existing_group->ids = group.ids;
+    else
+      groups.push_back(group);
+
+    // Scenes of this group need recompilation
+    for (auto& scene : scenes)
+      if (scene.group == group.name)
+        compileScene(scene);
+  } else
+
+  if (web_server.hasArg("scene")) {
+    Scene scene;
+    scene.name = web_server.arg("scene");
+    scene.name.trim();
+    scene.group = web_server.arg("of");
+    if (!isValidName(scene.name) || findGroup(scene.name) || !findGroup(scene.group))
+      return false;
+    scene.power = web_server.arg("power").toInt();
+    scene.bright = constrain(web_server.arg("bright").toInt(), 0L, 100L);
+    scene.ct = web_server.arg("ct").toInt();
+    if (scene.ct)
+      scene.ct = constrain(scene.ct, (uint16_t)1700, (uint16_t)6500);
+    scene.ramp = constrain(web_server.arg("ramp").toInt(), 0L, (long)RAMP_MAX);
+    compileScene(scene);
+
+    auto existing_scene = std::find_if(scenes.begin(), scenes.end(), [&](const Scene& s) { return s.name == scene.name; });
+    if (existing_scene != scenes.end())
+      *existing_scene = scene;
+    else {
+      String action(F("scene "));
+      const auto prefix = action.length();
+      action += scene.name;
+      System::addTimerAction(action, timerScene, prefix);
+      scenes.push_back(scene);
+    }
+  } else
+    return false;
+
+  return storeGroups();
+}
+
+// Save power and light state of active bulbs under a given name. Returns true on success
+// File format (one line per bulb, fields separated by tabs):
+//   <bulb ID> <power> <brightness> <CT> <RGB> <hue> <saturation> <color mode>
+//// The state is the one from the last refresh
+bool BulbManager::saveSnapshot(const String& name) {
+  if (!isValidName(name) || !isLinked())
+    return false;
+  auto snapshot_file = System::fs.open(String(FPSTR(SNAPSHOT_DIR)) + '/' + name, "w");
+  if (!snapshot_file)
+    return false;
+
+  String snapshot;
+  for (const auto bulb : bulbs) {
+    if (!bulb->isActive())
+      continue;
+    const auto& state = bulb->getState();
+    snapshot += bulb->getID();
+    snapshot += '\t';
+    snapshot += bulb->getPower();
+    snapshot += '\t';
+    snapshot += state.bright;
+    snapshot += '\t';
+    snapshot += state.ct;
+    snapshot += '\t';
+    snapshot += state.rgb;
+    snapshot += '\t';
+    snapshot += state.hue;
+    snapshot += '\t';
+    snapshot += state.sat;
+    snapshot += '\t';
+    snapshot += state.mode;
+    snapshot += '\n';
+  }
+  const auto ret = snapshot_file.print(snapshot) == snapshot.length();
+  snapshot_file.close();
+  if (ret) {
+    String action(F("restore "));
+    const auto prefix = action.length();
+    action += name;
+    System::addTimerAction(action, timerRestore, prefix);
+    System::log->printf(TIMED("Snapshot \"%s\" saved\n"), name.c_str());
+  }
+  return ret;
+}
+
+// Bring bulbs to a saved state. Returns true on full success
+//// Only the settings differing from the current bulb state are sent, and all commands for a bulb go in one connection
+bool BulbManager::restoreSnapshot(const String& name, const String& reason) {
+  if (!isValidName(name))    // Keep the name within the snapshots folder
+    return false;
+  auto snapshot_file = System::fs.open(String(FPSTR(SNAPSHOT_DIR)) + '/' + name, "r");
+  if (!snapshot_file) {
+    System::log->printf(TIMED("Snapshot \"%s\" not found\n"), name.c_str());
+    return false;
+  }
+
+  String msg(reason);
+  msg += reason.isEmpty() ? "Restoring" : "; restoring";
+  msg += F(" snapshot \"");
+  msg += name;
+  msg += '"';
+  System::appLogWriteLn(msg, true);
+
+  const auto old_powers = getPowers();
+  auto ret = true;
+  unsigned int ncmd = 0;
+  while (snapshot_file.available()) {
+    auto line = snapshot_file.readStringUntil('\n');
+    const auto sep = line.indexOf('\t');
+    if (sep == -1)
+      continue;
+    const auto bulb = find(line.substring(0, sep));
+    if (!bulb)
+      continue;
+
+    long fields[7];
+    int pos = sep;
+    for (auto& field : fields) {
+      field = pos == -1 ? 0 : line.substring(pos + 1).toInt();
+      if (pos != -1)
+        pos = line.indexOf('\t', pos + 1);
+    }
+    const bool power = fields[0];
+    const YBulbState state = {(uint32_t)fields[3], (uint16_t)fields[2], (uint16_t)fields[4], (uint8_t)fields[1], (uint8_t)fields[5], (uint8_t)fields[6]};
+
+    const auto frame = restoreMessage(bulb, power, state);
+    if (frame.isEmpty())
+      continue;     // Already there
+    if (bulb->send(frame)) {
+      ncmd += YBulb::countCommands(frame);
+      bulb->setPower(power);
+      if (power)
+        bulb->setState(state);
+    } else {
+      System::log->printf(TIMED("Bulb %s is not reachable\n"), bulb->getID().c_str());
+      ret = false;
+      yield();
+    }
+  }
+  snapshot_file.close();
+  System::log->printf(TIMED("Snapshot \"%s\" restored with %u command(s)\n"), name.c_str(), ncmd);
+  processRules(old_powers);
+  refreshSoon();
+  return ret;
+}
+
+// Compose bulb command messages bringing it to a given power and light state
+//// Nothing is returned if the bulb is already in this state. When the bulb is to be turned on, or both brightness and color differ,
+//// "set_scene" does all in one command
+String BulbManager::restoreMessage(const YBulb *bulb, const bool power, const YBulbState& target) {
+  static const uint16_t RESTORE_TRANSITION = 500;   // (ms)
+
+  String msg;
+  if (!power) {
+    if (bulb->getPower())
+      msg = YBulb::message(YL_METHOD_SET_POWER, String(F("\"off\"")) + YBulb::transition(RESTORE_TRANSITION));
+    return msg;
+  }
+
+  const auto& current = bulb->getState();
+  const auto bright_differs = target.bright && target.bright != current.bright;
+  auto color_differs = false;
+  auto color_method = YL_METHOD_INVALID;
+  String color_params;
+  String scene_params;
+  switch (target.mode) {
+    case YL_MODE_CT:
+      color_differs = current.mode != YL_MODE_CT || current.ct != target.ct;
+      color_method = YL_METHOD_SET_CT_ABX;
+      color_params += target.ct;
+      scene_params = F("\"ct\",");
+      break;
+
+    case YL_MODE_RGB:
+      color_differs = current.mode != YL_MODE_RGB || current.rgb != target.rgb;
+      color_method = YL_METHOD_SET_RGB;
+      color_params += target.rgb;
+      scene_params = F("\"color\",");
+      break;
+
+    case YL_MODE_HSV:
+      color_differs = current.mode != YL_MODE_HSV || current.hue != target.hue || current.sat != target.sat;
+      color_method = YL_METHOD_SET_HSV;
+      color_params += target.hue;
+      color_params += ',';
+      color_params += target.sat;
+      scene_params = F("\"hsv\",");
+      break;
+
+    default: ;
+  }
+  color_differs &= bulb->supports(color_method);
+
+  if (color_method != YL_METHOD_INVALID && target.bright && bulb->supports(YL_METHOD_SET_SCENE)
+    && ((!bulb->getPower() && (bright_differs || color_differs)) || (bright_differs && color_differs))) {
+    scene_params += color_params;
+    scene_params += ',';
+    scene_params += target.bright;
+    return YBulb::message(YL_METHOD_SET_SCENE, scene_params);
+  }
+
+  if (!bulb->getPower())
+    msg += YBulb::message(YL_METHOD_SET_POWER, String(F("\"on\"")) + YBulb::transition(RESTORE_TRANSITION));
+  if (bright_differs && bulb->supports(YL_METHOD_SET_BRIGHT)) {
+    String params;
+    params += target.bright;
+    params += YBulb::transition(RESTORE_TRANSITION);
+    msg += YBulb::message(YL_METHOD_SET_BRIGHT, params);
+  }
+  if (color_differs)
+    msg += YBulb::message(color_method, color_params + YBulb::transition(RESTORE_TRANSITION));
+  return msg;
+}
+
+// Delete saved state. Returns true on success
+bool BulbManager::deleteSnapshot(const String& name) {
+  if (!isValidName(name))
+    return false;
+  System::removeTimerAction(String(F("restore ")) + name);
+  return System::fs.remove(String(FPSTR(SNAPSHOT_DIR)) + '/' + name);
+}
+
+// Return names of saved states
+std::vector<String> BulbManager::getSnapshots() const {
+  std::vector<String> names;
+  auto dir = System::fs.openDir(FPSTR(SNAPSHOT_DIR));
+  while (dir.next())
+    names.push_back(dir.fileName());
+  return names;
+}
+
+// Load automation rules
+// File format (one rule per line, fields separated by tabs):
+//   <trigger bulb ID> <event (1 = on, 0 = off)> <condition> <target bulb ID> <action>
+void BulbManager::loadRules() {
+  rules.clear();
+  String cfg_name(FPSTR(System::sys_folder_name));
+  cfg_name += '/';
+  cfg_name += FPSTR(RULES_CFG_NAME);
+  auto cfg_file = System::fs.open(cfg_name, "r");
+  if (cfg_file) {
+    while (cfg_file.available()) {
+      auto line = cfg_file.readStringUntil('\n');
+      Rule rule;
+      auto sep = line.indexOf('\t');
+      if (sep == -1)
+        continue;
+      rule.trigger = line.substring(0, sep);
+      line.remove(0, sep + 1);
+      rule.on = line.toInt();
+      line.remove(0, line.indexOf('\t') + 1);
+      rule.when = line.toInt();
+      line.remove(0, line.indexOf('\t') + 1);
+      sep = line.indexOf('\t');
+      if (sep == -1 || rule.when >= RULE_INVALID)
+        continue;
+      rule.target = line.substring(0, sep);
+      rule.action = constrain(line.substring(sep + 1).toInt(), -1L, 100L);
+      rules.push_back(rule);
+    }
+    cfg_file.close();
+  }
+  compileRules();
+  System::log->printf(TIMED("Loaded %u rule(s)\n"), rules.size());
+}
+
+// Store automation rules. Returns true on success
+bool BulbManager::storeRules() const {
+  String cfg_name(FPSTR(System::sys_folder_name));
+  cfg_name += '/';
+  cfg_name += FPSTR(RULES_CFG_NAME);
+  auto cfg_file = System::fs.open(cfg_name, "w");
+  if (!cfg_file)
+    return false;
+
+  String cfg;
+  for (const auto& rule : rules) {
+    cfg += rule.trigger;
+    cfg += '\t';
+    cfg += rule.on;
+    cfg += '\t';
+    cfg += rule.when;
+    cfg += '\t';
+    cfg += rule.target;
+    cfg += '\t';
+    cfg += rule.action;
+    cfg += '\n';
+  }
+  const auto ret = cfg_file.print(cfg) == cfg.length();
+  cfg_file.close();
+  return ret;
+}
+
+// Build rule table from rules
+//// The table has a slot per bulb and event, so that an event finds its rules without looking through all of them.
+//// Bulbs are never removed from the list, so their numbers are stable; the table needs rebuilding after discovery and rule changes
+void BulbManager::compileRules() {
+  rule_table.assign(bulbs.size() * 2, std::vector<uint8_t>());
+  for (uint8_t r = 0; r < rules.size(); r++)
+    for (size_t i = 0; i < bulbs.size(); i++)
+      if (*bulbs[i] == rules[r].trigger) {
+        rule_table[i * 2 + rules[r].on].push_back(r);
+        break;
+      }
+}
+
+// Execute rules triggered by a bulb (number) changing power state
+void BulbManager::processRules(const size_t bulb_num, const bool power) {
+  const auto slot = bulb_num * 2 + power;
+  if (rules_running || slot >= rule_table.size() || rule_table[slot].empty())
+    return;
+
+  rules_running = true;       // Rule actions do not trigger rules, so rules cannot loop
+  for (const auto r : rule_table[slot]) {
+    const auto& rule = rules[r];
+    const auto target = find(rule.target);
+    if (!target || !isRuleTime(rule.when))
+      continue;
+
+    String msg(F("Bulb "));
+    msg += bulbs[bulb_num]->getName().isEmpty() ? bulbs[bulb_num]->getShortID() : bulbs[bulb_num]->getName();
+    msg += power ? F(" turned on") : F(" turned off");
+    msg += F("; rule sets bulb ");
+    msg += target->getName().isEmpty() ? target->getShortID() : target->getName();
+    auto ok = true;
+    if (rule.action < 0) {
+      msg += F(" OFF");
+      ok = target->turnOff();
+    } else {
+      ok = target->turnOn();
+      msg += F(" ON");
+      if (rule.action) {
+        msg += F(" at ");
+        msg += rule.action;
+        msg += '%';
+        ok = ok && target->setBright(rule.action, LIGHT_INTERVAL);
+      }
+    }
+    if (!ok)
+      msg += F(" (failed)");
+    System::appLogWriteLn(msg, true);
+  }
+  rules_running = false;
+  refreshSoon();
+}
+
+// Execute rules triggered by bulbs whose power state differs from a given one (indexed by bulb number)
+//// For commands other than power switching (scenes, snapshots, ramps), which may turn bulbs on or off as a side effect.
+//// Changes are collected first, so that bulbs switched by rule actions do not trigger rules themselves
+void BulbManager::processRules(const std::vector<bool>& old_powers) {
+  std::vector<size_t> switched;
+  for (size_t i = 0; i < bulbs.size() && i < old_powers.size(); i++)
+    if (bulbs[i]->getPower() != old_powers[i])
+      switched.push_back(i);
+  for (const auto i : switched)
+    processRules(i, !old_powers[i]);
+}
+
+// Return power states of bulbs (indexed by bulb number)
+std::vector<bool> BulbManager::getPowers() const {
+  std::vector<bool> powers;
+  for (const auto bulb : bulbs)
+    powers.push_back(bulb->getPower());
+  return powers;
+}
+
+// Return true if rule condition is met at the moment
+bool BulbManager::isRuleTime(const uint8_t when) const {
+  if (when == RULE_ALWAYS)
+    return true;
+  if (System::getTimeSyncStatus() == TIME_SYNC_NONE)
+    return false;       // Time unknown
+  const uint16_t now = System::tm_time.tm_hour * 60 + System::tm_time.tm_min;
+  const auto day = now >= System::getSunrise() && now < System::getSunset();
+  return when == RULE_DAY ? day : !day;
 }
 
 // Activate all bulbs
@@ -283,7 +1465,7 @@ static const char *TABLE_DEF PROGMEM =
   "<table border=\"1\" cellpadding=\"3\" cellspacing=\"0\" style=\"font-family: monospace; border-collapse: collapse; font-size: small;\">\n";
 
 static const char *TABLE_HEAD PROGMEM =
-    "<th>Name</th><th>ID</th><th>IP Address</th><th>Model</th><th>Power</th>";
+    "<th>Name</th><th>ID</th><th>IP Address</th><th>Model</th><th>Power</th><th>Light</th>";
 
 // Print bulbs status in HTML
 void BulbManager::printStatusHTML(String &page) const {
@@ -296,7 +1478,7 @@ void BulbManager::printStatusHTML(String &page) const {
       if (bulb->isActive())
         bulb->printStatusHTML(page);
   } else
-    page += F("<tr><td colspan=\"5\" style=\"text-align: center\">-= Not linked to a bulb =-</tr>\n");
+    page += F("<tr><td colspan=\"6\" style=\"text-align: center\">-= Not linked to a bulb =-</tr>\n");
   page += F("</table>\n");
 }
 
@@ -309,6 +1491,168 @@ void BulbManager::printConfHTML(String &page) const {
   for (uint8_t i = 0; i < bulbs.size(); i++)
     bulbs[i]->printConfHTML(page, i);
   page += F("</table>\n");
+
+  page += F("<p>When linked bulbs disagree, consider them ON if <select name=\"policy\">");
+  for (uint8_t p = 0; p < POLICY_INVALID; p++) {
+    page += F("<option value=\"");
+    page += p;
+    page += '"';
+    if (p == policy)
+      page += F(" selected=\"selected\"");
+    page += '>';
+    switch (p) {
+      case POLICY_MAJORITY: page += F("most of them are ON");      break;
+      case POLICY_ANY_ON:   page += F("any of them is ON");        break;
+      case POLICY_LEADER:   page += F("the first one is ON");      break;
+    }
+    page += F("</option>");
+  }
+  page += F("</select></p>\n");
+}
+
+// Print groups and scenes configuration controls in HTML
+void BulbManager::printGroupsHTML(String &page) const {
+
+  // Existing groups and scenes
+  page += TABLE_DEF;
+  page += F("<tr><th>Name</th><th>Type</th><th>Settings</th><th></th></tr>\n");
+  for (const auto& group : groups) {
+    page += F("<tr><td>");
+    page += group.name;
+    page += F("</td><td>group</td><td>");
+    for (const auto& id : group.ids) {
+      const auto bulb = find(id);
+      page += bulb && !bulb->getName().isEmpty() ? bulb->getName() : id.substring(11);
+      page += ' ';
+    }
+    page += F("</td><td><a href=\"/groups-save?del=");
+    page += urlName(group.name);
+    page += F("\">delete</a></td></tr>\n");
+  }
+  for (const auto& scene : scenes) {
+    page += F("<tr><td>");
+    page += scene.name;
+    page += F("</td><td>scene</td><td>");
+    page += scene.group;
+    page += scene.power ? F(": on") : F(": off");
+    if (scene.power && scene.bright) {
+      page += F(", ");
+      page += scene.bright;
+      page += '%';
+    }
+    if (scene.power && scene.ct) {
+      page += F(", ");
+      page += scene.ct;
+      page += 'K';
+    }
+    if (scene.ramp) {
+      page += F(" over ");
+      page += scene.ramp;
+      page += F(" min");
+    }
+    page += F("</td><td><a href=\"/?scene=");
+    page += urlName(scene.name);
+    page += F("\">activate</a> <a href=\"/groups-save?del=");
+    page += urlName(scene.name);
+    page += F("\">delete</a></td></tr>\n");
+  }
+  if (groups.empty() && scenes.empty())
+    page += F("<tr><td colspan=\"4\" style=\"text-align: center\">-= No groups defined =-</tr>\n");
+  page += F("</table>\n");
+
+  // Rules
+  page += F("<p>Rules:<br/>\n");
+  for (uint8_t r = 0; r < rules.size(); r++) {
+    const auto& rule = rules[r];
+    const auto trigger = find(rule.trigger);
+    const auto target = find(rule.target);
+    page += F("When ");
+    page += trigger && !trigger->getName().isEmpty() ? trigger->getName() : rule.trigger.substring(11);
+    page += rule.on ? F(" turns on") : F(" turns off");
+    page += rule.when == RULE_NIGHT ? F(" at night") : rule.when == RULE_DAY ? F(" by day") : F("");
+    page += F(", set ");
+    page += target && !target->getName().isEmpty() ? target->getName() : rule.target.substring(11);
+    if (rule.action < 0)
+      page += F(" off");
+    else {
+      page += F(" on");
+      if (rule.action) {
+        page += F(" at ");
+        page += rule.action;
+        page += '%';
+      }
+    }
+    page += F(" [<a href=\"/groups-save?delrule=");
+    page += r;
+    page += F("\">delete</a>]<br/>\n");
+  }
+  if (rules.empty())
+    page += F("<i>none</i><br/>\n");
+  page += F("</p>\n");
+  if (bulbs.size() > 1) {
+    String bulb_options;
+    for (uint8_t i = 0; i < bulbs.size(); i++) {
+      bulb_options += F("<option value=\"");
+      bulb_options += i;
+      bulb_options += F("\">");
+      bulb_options += bulbs[i]->getName().isEmpty() ? bulbs[i]->getShortID() : bulbs[i]->getName();
+      bulb_options += F("</option>");
+    }
+    page += F("<form action=\"/groups-save\">\n<p><input type=\"hidden\" name=\"rule\"/>When <select name=\"src\">");
+    page += bulb_options;
+    page += F("</select> turns <select name=\"ev\"><option value=\"1\">on</option><option value=\"0\">off</option></select>"
+      " <select name=\"when\"><option value=\"0\">any time</option><option value=\"1\">at night</option><option value=\"2\">by day</option></select>,"
+      " set <select name=\"dst\">");
+    page += bulb_options;
+    page += F("</select> <select name=\"act\"><option value=\"0\">on</option><option value=\"-1\">off</option>"
+      "<option value=\"10\">on at 10%</option><option value=\"30\">on at 30%</option><option value=\"50\">on at 50%</option>"
+      "<option value=\"100\">on at 100%</option></select>"
+      " <input type=\"submit\" value=\"Add rule\"/></p>\n</form>\n");
+  }
+
+  // Snapshots
+  page += F("<p>Snapshots: ");
+  const auto snapshots = getSnapshots();
+  for (const auto& name : snapshots) {
+    page += name;
+    page += F(" [<a href=\"/?restore=");
+    page += urlName(name);
+    page += F("\">restore</a>|<a href=\"/groups-save?delsnap=");
+    page += urlName(name);
+    page += F("\">delete</a>] ");
+  }
+  if (snapshots.empty())
+    page += F("<i>none</i>");
+  page += F("</p>\n<form action=\"/groups-save\">\n<p>Save current state of linked bulbs as <input type=\"text\" name=\"snapshot\" size=\"10\"/>"
+    " <input type=\"submit\" value=\"Save snapshot\"/></p>\n</form>\n");
+
+  // New group
+  page += F("<form action=\"/groups-save\">\n<p>Group <input type=\"text\" name=\"group\" size=\"10\"/> of:<br/>\n");
+  for (uint8_t i = 0; i < bulbs.size(); i++) {
+    page += F("<input type=\"checkbox\" name=\"bulb\" value=\"");
+    page += i;
+    page += F("\"/>");
+    page += bulbs[i]->getName().isEmpty() ? bulbs[i]->getShortID() : bulbs[i]->getName();
+    page += F(" (");
+    page += bulbs[i]->getIP().toString();
+    page += F(")<br/>\n");
+  }
+  page += F("<input type=\"submit\" value=\"Save group\"/></p>\n</form>\n");
+
+  // New scene
+  if (!groups.empty()) {
+    page += F("<form action=\"/groups-save\">\n<p>Scene <input type=\"text\" name=\"scene\" size=\"10\"/> for group <select name=\"of\">");
+    for (const auto& group : groups) {
+      page += F("<option>");
+      page += group.name;
+      page += F("</option>");
+    }
+    page += F("</select><br/>\n<select name=\"power\"><option value=\"1\">on</option><option value=\"0\">off</option></select>"
+      " brightness <input type=\"number\" name=\"bright\" min=\"0\" max=\"100\" value=\"0\"/> %"
+      " color temperature <input type=\"number\" name=\"ct\" min=\"0\" max=\"6500\" step=\"100\" value=\"0\"/> K"
+      " <i>(0 = keep)</i><br/>\nslow transition over <input type=\"number\" name=\"ramp\" min=\"0\" max=\"60\" value=\"0\"/> min"
+      " <i>(0 = none)</i><br/>\n<input type=\"submit\" value=\"Save scene\"/></p>\n</form>\n");
+  }
 }
 
 // Define a singleton-like instance
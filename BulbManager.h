@@ -15,28 +15,137 @@ class BulbManager {
 
     std::vector<ds::YBulb *> bulbs;        // List of known bulbs
     uint8_t nabulbs;                       // Number of active bulbs
+    unsigned long refresh_interval;        // Current bulb state refresh interval (ms)
+    unsigned long t_refresh;               // Last bulb state refresh time (ms)
+    bool refresh_changed;                  // True if the ongoing refresh has detected a state change
+    ds::YBulbState light_target;           // Requested light settings, not yet sent to bulbs
+    uint8_t light_pending;                 // Requested light settings (bitmask of yprop_t)
+    String light_group;                    // Group the requested light settings apply to (empty = active bulbs)
+    unsigned long t_light;                 // Last time light settings were sent (ms)
+    int8_t dim_step;                       // Brightness change per dimming step (%; 0 = not dimming)
+    int8_t dim_level;                      // Current dimming brightness level (%)
+    bool dim_up;                           // Direction of the last dimming (true = brighter)
+    unsigned long t_dim;                   // Last dimming step time (ms)
+    std::vector<std::pair<String, unsigned long>> local_offs; // Delayed offs for bulbs without own timer: group (empty = active bulbs) and time to turn it off (ms)
+    uint32_t rtcmem_crc;                   // Checksum of the bulb list last stored in RTC memory
 
-    static const uint8_t EEPROM_FORMAT_VERSION = 49;  // The first version of the format stored 1 bulb id right after the marker. ID stars with ASCII '0' == 48
+    static const unsigned long REFRESH_INTERVAL_MIN = 5000;   // Bulb state refresh interval right after a change (ms)
+    static const unsigned long REFRESH_INTERVAL_MAX = 60000;  // Bulb state refresh interval when the state is stable (ms)
+    static const uint16_t LIGHT_INTERVAL = 500;               // Minimum interval between light adjustments; also their transition duration (ms)
+    static const uint8_t EEPROM_FORMAT_VERSION_V1 = 49;  // The first version of the format stored 1 bulb id right after the marker. ID stars with ASCII '0' == 48
+    static const uint8_t EEPROM_FORMAT_VERSION = 50;  // Group state rule added
 
     ds::YBulb* find(const String&) const;  // Find a bulb by ID
     ds::YBulb* find(const ds::YBulb&) const;          // Find a bulb with the same ID
+    bool loadRTC();                        // Recover bulb list from RTC memory after a warm reset. Returns true on success
+    void storeRTC();                       // Store bulb list into RTC memory, if it has changed
 
   public:
 
-    typedef enum Event { EVENT_FLIP, EVENT_ON, EVENT_OFF } event_t; // Possible actions
+    static const uint16_t DIM_INTERVAL = 200;          // Interval between dimming steps; also their transition duration (ms)
+    static const uint8_t DIM_STEP = 10;                // Brightness change per dimming step (%). Full range takes 10 steps, which fits in the bulb command burst
+    static const uint8_t RAMP_MAX = 60;                // Longest transition (min)
+    static const uint8_t RULES_MAX = 32;               // Maximum number of rules
 
-    BulbManager() : nabulbs(0) {}          // Constructor
+    typedef enum Event { EVENT_FLIP, EVENT_ON, EVENT_OFF, EVENT_SCENE } event_t; // Possible actions
+    typedef enum Policy { POLICY_MAJORITY, POLICY_ANY_ON, POLICY_LEADER, POLICY_INVALID } policy_t; // Group state rules for discordant bulbs
+
+    // Named group of bulbs
+    struct Group {
+      String name;                         // Group name
+      std::vector<String> ids;             // Member bulb IDs
+    };
+
+    // Named scene (light settings for a group of bulbs). Settings are precompiled into bulb command messages
+    struct Scene {
+      String name;                         // Scene name
+      String group;                        // Name of the group the scene applies to
+      bool power;                          // Power state (true = "on")
+      uint8_t bright;                      // Brightness (%; 0 = keep)
+      uint16_t ct;                         // Color temperature (K; 0 = keep)
+      uint8_t ramp;                        // Transition duration (min; 0 = short transition). Turning on ramps up from the lowest brightness
+      std::vector<std::pair<String, String>> frames;  // Bulb ID and command messages to send to it
+    };
+
+    // Automation rule: when a bulb changes power state under a condition, act on another bulb
+    struct Rule {
+      String trigger;                      // Trigger bulb ID
+      bool on;                             // Trigger event (true = turned on, false = turned off)
+      uint8_t when;                        // Condition (rule_when_t)
+      String target;                       // Target bulb ID
+      int8_t action;                       // Action (-1 = turn off, 0 = turn on, 1..100 = turn on at this brightness %)
+    };
+    typedef enum RuleWhen { RULE_ALWAYS, RULE_NIGHT, RULE_DAY, RULE_INVALID } rule_when_t; // Rule conditions
+
+  protected:
+
+    policy_t policy;                       // Group state rule
+    std::vector<Group> groups;             // Bulb groups
+    std::vector<Scene> scenes;             // Scenes
+
+    static const char *GROUPS_CFG_NAME;    // Groups and scenes configuration file
+    static const char *SNAPSHOT_DIR;       // Snapshots folder
+    static const char *RULES_CFG_NAME;     // Rules configuration file (in system folder)
+    std::vector<Rule> rules;               // Automation rules
+    std::vector<std::vector<uint8_t>> rule_table; // Rule numbers indexed by trigger (bulb number * 2 + event)
+    bool rules_running;                    // True while rule actions are executed (they do not trigger further rules)
+
+    bool setPower(const bool, const Group *group = nullptr); // Bring bulbs to a given power state. Returns true on full success
+    bool isSelected(const ds::YBulb *, const Group *group = nullptr) const; // Return true if bulb is subject to control (group member or, by default, active)
+    bool activateScene(const Scene&);      // Send scene settings to bulbs. Returns true on full success
+    void compileScene(Scene&) const;       // Prepare scene command messages
+    static String restoreMessage(const ds::YBulb *, const bool, const ds::YBulbState&); // Compose bulb command messages bringing it to a given power and light state
+    static String rampMessage(const ds::YBulb *, const uint8_t, const bool, const uint8_t, const uint16_t); // Compose bulb command messages for a long transition
+    void loadGroups();                     // Load groups and scenes configuration
+    bool storeGroups() const;              // Store groups and scenes configuration. Returns true on success
+    bool applyLight();                     // Send requested light settings to bulbs. Returns true on full success
+    void stepDimming();                    // Send the next dimming step to bulbs
+    void loadRules();                      // Load automation rules
+    bool storeRules() const;               // Store automation rules. Returns true on success
+    void compileRules();                   // Build rule table from rules
+    void processRules(const size_t, const bool); // Execute rules triggered by a bulb (number) changing power state
+    void processRules(const std::vector<bool>&); // Execute rules triggered by bulbs whose power state differs from a given one (indexed by bulb number)
+    std::vector<bool> getPowers() const;   // Return power states of bulbs (indexed by bulb number)
+    bool isRuleTime(const uint8_t) const;  // Return true if rule condition is met at the moment
+
+  public:
+
+    BulbManager() : nabulbs(0), refresh_interval(REFRESH_INTERVAL_MIN), t_refresh(0), refresh_changed(false),
+      light_target({0, 0, 0, 0, 0, ds::YL_MODE_UNKNOWN}), light_pending(0), t_light(0),
+      dim_step(0), dim_level(0), dim_up(false), t_dim(0), rtcmem_crc(0), policy(POLICY_MAJORITY),
+      rules_running(false) {} // Constructor
     ~BulbManager();                        // Destructor
     void begin();                          // Start operation
-    void processEvent(event_t, const String&); // Process external event
+    void update();                         // Background processing (state refresh)
+    void refreshSoon();                    // Schedule bulb state refresh at the fastest rate
+    void processEvent(event_t, const String& reason = "", const String& target = ""); // Process external event. Target is a group name (a scene name for EVENT_SCENE); empty means active bulbs
     void load();                           // Load stored configuration
     void save();                           // Save new configuration
+    bool saveGroups();                     // Save new groups and scenes configuration. Returns true on success
     uint8_t discover();                    // Discover bulbs. Returns number of known bulbs
-    bool turnOn();                         // Turn on bulbs. Returns true on full success
-    bool turnOff();                        // Turn off bulbs. Returns true on full success
-    bool flip();                           // Flip bulbs. Returns true on full success
-    bool isOn() const;                     // Return true if lights are on
-    bool isOff() const { return !isOn(); } // Return true if lights are off
+    bool turnOn(const Group *group = nullptr);  // Turn on bulbs. Returns true on full success
+    bool turnOff(const Group *group = nullptr); // Turn off bulbs. Returns true on full success
+    bool flip(const Group *group = nullptr);    // Flip bulbs. Returns true on full success
+    bool isOn(const Group *group = nullptr) const;  // Return true if lights are on
+    bool isOff(const Group *group = nullptr) const { return !isOn(group); } // Return true if lights are off
+    bool isDiscordant(const Group *group = nullptr) const; // Return true if bulbs are not in the same power state
+    void setLight(const ds::yprop_t, const uint32_t, const String& target = ""); // Request light setting (YL_PROP_BRIGHT, YL_PROP_CT or YL_PROP_RGB) for a group (empty = active bulbs)
+    const ds::YBulb *getLeader(const Group *group = nullptr) const; // Return the first controlled bulb, if any
+    bool saveSnapshot(const String&);      // Save power and light state of active bulbs under a given name. Returns true on success
+    bool restoreSnapshot(const String&, const String& reason = ""); // Bring bulbs to a saved state. Returns true on full success
+    bool deleteSnapshot(const String&);    // Delete saved state. Returns true on success
+    std::vector<String> getSnapshots() const; // Return names of saved states
+    bool delayOff(const uint16_t, const String& reason = "", const String& target = ""); // Turn bulbs off in a given number of minutes (0 = cancel; at most 24 h). Target is a group name; empty means active bulbs. Returns true on full success
+    bool startRamp(const uint8_t, const bool, const uint8_t bright = 100, const uint16_t ct = 0, const Group *group = nullptr); // Start a long transition (min) to a power state, brightness (%) and color temperature (K; 0 = keep). Returns true on full success
+    void startDimming();                   // Start changing brightness of active bulbs (direction alternates between calls)
+    void stopDimming(const String& reason = ""); // Stop changing brightness
+    bool isDimming() const { return dim_step; }  // True if brightness is being changed
+    policy_t getPolicy() const { return policy; }    // Return group state rule
+    void setPolicy(const policy_t new_policy) { policy = new_policy < POLICY_INVALID ? new_policy : POLICY_MAJORITY; } // Set group state rule
+    const Group *findGroup(const String&) const;     // Find a group by name
+    const Scene *findScene(const String&) const;     // Find a scene by name
+    static bool isValidName(const String&);          // Return true if a string is usable as a group, scene, snapshot or macro name
+    static String urlName(const String&);            // Return a name for use as a URL query value
     void activateAll();                    // Activate all bulbs
     void deactivateAll();                  // Deactivate all bulbs
     uint8_t getNum() const { return bulbs.size(); }  // Return number of known bulbs
@@ -44,6 +153,7 @@ class BulbManager {
     bool isLinked() const { return nabulbs; }        // Return true if there are linked bulbs
     void printStatusHTML(String &) const;  // Print bulbs status in HTML
     void printConfHTML(String &) const;    // Print bulb configuration controls in HTML
+    void printGroupsHTML(String &) const;  // Print groups and scenes configuration controls in HTML
 };
 
 // Declare a singleton-like instance
@@ -19,6 +19,7 @@
 ////// For ESP-01(S), use board "Generic ESP8266 Module"; Flash Size "1MB (FS:256KB)"; Builtin LED: 1 for ESP-01, 2 for ESP-01S. Connect a push button between GPIO0 and GND
 
 // #define BUTTON_BUILTIN 0               // Uncomment and define if your button is connected to a GPIO other than 0
+#define BUTTON_DIMMING_DELAY 600          // Holding the button for this long (ms) starts dimming the light. Comment out to disable (the light then flips on press rather than on release)
 // === End of user configuration
 
 // Changing below this line will require code adaptations elsewhere in the app
@@ -26,6 +27,7 @@
 #define DS_CAP_APP_LOG           // Enable application log
 #define DS_CAP_SYS_LED           // Enable builtin LED
 #define DS_CAP_SYS_LOG_HW        // Enable syslog on hardware serial line
+#define DS_CAP_SYS_RTCMEM        // Enable RTC memory
 #define DS_CAP_SYS_TIME          // Enable system time
 #define DS_CAP_SYS_FS            // Enable file system
 #define DS_CAP_SYS_NETWORK       // Enable networking
@@ -0,0 +1,281 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Macro sequencer
+ * (c) DNS 2021
+ */
+
+#include "MySystem.h"                      // System-level definitions
+#include "BulbManager.h"                   // Bulb manager
+#include "Sequencer.h"                     // Macro sequencer
+
+using namespace ds;
+
+extern void timerMacro(const Timer*, const int32_t);   // Timer action: run macro (see timer.cpp)
+
+const char *Sequencer::MACROS_CFG_NAME PROGMEM = "/macros.cfg";   // Macros configuration file
+
+// Constructor
+Sequencer::Sequencer() {
+  for (auto& sequence : sequences)
+    sequence.macro = -1;
+}
+
+// Start operation (load macros)
+// File format (one macro per line): <name> <tab> <script>
+void Sequencer::begin() {
+  macros.clear();
+  auto cfg_file = System::fs.open(MACROS_CFG_NAME, "r");
+  if (cfg_file) {
+    while (cfg_file.available()) {
+      const auto line = cfg_file.readStringUntil('\n');
+      const auto sep = line.indexOf('\t');
+      if (sep == -1)
+        continue;
+      Macro macro;
+      macro.name = line.substring(0, sep);
+      macro.script = line.substring(sep + 1);
+      if (macros.size() < MACROS_MAX && compile(macro)) {
+        addTimerAction(macro.name);
+        macros.push_back(macro);
+      }
+    }
+    cfg_file.close();
+  }
+  System::log->printf(TIMED("Loaded %u macro(s)\n"), macros.size());
+}
+
+// Background processing (run sequences)
+//// Steps due are executed one after another until a wait step, so loop() is never held for a wait
+void Sequencer::update() {
+  for (uint8_t i = 0; i < SEQUENCES_MAX; i++) {
+    auto& sequence = sequences[i];
+    while (sequence.macro >= 0 && (long)(millis() - sequence.t_next) >= 0) {
+      const auto& macro = macros[sequence.macro];
+      if (sequence.step >= macro.steps.size()) {
+        System::log->printf(TIMED("Macro \"%s\" finished\n"), macro.name.c_str());
+        stop(i);
+        break;
+      }
+
+      const auto& step = macro.steps[sequence.step++];
+      String reason(F("Macro \""));
+      reason += macro.name;
+      reason += F("\" step ");
+      reason += sequence.step;
+      switch (step.op) {
+        case OP_ON:     bulb_manager.processEvent(BulbManager::EVENT_ON, reason);   break;
+        case OP_OFF:    bulb_manager.processEvent(BulbManager::EVENT_OFF, reason);  break;
+        case OP_FLIP:   bulb_manager.processEvent(BulbManager::EVENT_FLIP, reason); break;
+        case OP_BRIGHT: bulb_manager.setLight(YL_PROP_BRIGHT, step.arg);            break;
+        case OP_CT:     bulb_manager.setLight(YL_PROP_CT, step.arg);                break;
+        case OP_RGB:    bulb_manager.setLight(YL_PROP_RGB, step.arg);               break;
+        case OP_WAIT:   sequence.t_next = millis() + step.arg;                      break;
+        default: ;
+      }
+    }
+  }
+}
+
+// Start a macro by name. Returns true on success
+//// A macro already running is restarted. If all slots are busy, the macro is not started
+bool Sequencer::start(const String& name, const String& reason) {
+  int8_t macro = -1;
+  for (uint8_t m = 0; m < macros.size(); m++)
+    if (macros[m].name == name) {
+      macro = m;
+      break;
+    }
+  if (macro == -1) {
+    System::log->printf(TIMED("Macro \"%s\" not found\n"), name.c_str());
+    return false;
+  }
+
+  Sequence *slot = nullptr;
+  for (auto& sequence : sequences)
+    if (sequence.macro == macro) {
+      slot = &sequence;
+      break;
+    } else
+    if (sequence.macro == -1 && !slot)
+      slot = &sequence;
+
+  String msg(reason);
+  msg += reason.isEmpty() ? "Starting" : "; starting";
+  msg += F(" macro \"");
+  msg += name;
+  msg += '"';
+  if (!slot)
+    msg += F(" failed: too many macros running");
+  System::appLogWriteLn(msg, true);
+  if (!slot)
+    return false;
+
+  slot->macro = macro;
+  slot->step = 0;
+  slot->t_next = millis();
+  return true;
+}
+
+// Stop sequence in a given slot
+void Sequencer::stop(const uint8_t slot) {
+  sequences[slot].macro = -1;
+}
+
+// True if some macro is running
+bool Sequencer::isRunning() const {
+  for (const auto& sequence : sequences)
+    if (sequence.macro >= 0)
+      return true;
+  return false;
+}
+
+// Compile macro script into steps. Returns true on success
+//// Steps are separated with ';': "on", "off", "flip", "bright <%>", "ct <K>", "rgb <RRGGBB>", "wait <number>[s|m|h]"
+bool Sequencer::compile(Macro& macro) {
+  static const uint8_t STEPS_MAX = 32;
+
+  macro.steps.clear();
+  int start = 0;
+  while (start < (int)macro.script.length()) {
+    auto end = macro.script.indexOf(';', start);
+    if (end == -1)
+      end = macro.script.length();
+    auto text = macro.script.substring(start, end);
+    start = end + 1;
+    text.trim();
+    if (text.isEmpty())
+      continue;
+
+    const auto sep = text.indexOf(' ');
+    const auto op_name = sep == -1 ? text : text.substring(0, sep);
+    auto arg = sep == -1 ? String() : text.substring(sep + 1);
+    arg.trim();
+    Step step = {OP_INVALID, 0};
+    if (op_name == "on")
+      step.op = OP_ON;
+    else if (op_name == "off")
+      step.op = OP_OFF;
+    else if (op_name == "flip")
+      step.op = OP_FLIP;
+    else if (op_name == "bright" && arg.toInt() >= 1 && arg.toInt() <= 100)
+      step = {OP_BRIGHT, (uint32_t)arg.toInt()};
+    else if (op_name == "ct" && arg.toInt() >= 1700 && arg.toInt() <= 6500)
+      step = {OP_CT, (uint32_t)arg.toInt()};
+    else if (op_name == "rgb" && arg.length() == 6)
+      step = {OP_RGB, (uint32_t)strtoul(arg.c_str(), nullptr, 16)};
+    else if (op_name == "wait" && arg.toInt() > 0) {
+      const auto unit = arg[arg.length() - 1];
+      const uint32_t mult = unit == 'h' ? 3600000 : unit == 'm' ? 60000 : 1000;
+      if ((uint32_t)arg.toInt() <= 24 * 3600000UL / mult)    // Checked before multiplying, which could overflow
+        step = {OP_WAIT, (uint32_t)arg.toInt() * mult};
+    }
+    if (step.op == OP_INVALID || macro.steps.size() >= STEPS_MAX) {
+      System::log->printf(TIMED("Macro \"%s\": invalid step \"%s\"\n"), macro.name.c_str(), text.c_str());
+      return false;
+    }
+    macro.steps.push_back(step);
+  }
+  return !macro.steps.empty();
+}
+
+// Offer macro as a timer action
+void Sequencer::addTimerAction(const String& name) {
+  String action(F("macro "));
+  const auto prefix = action.length();
+  action += name;
+  System::addTimerAction(action, timerMacro, prefix);
+}
+
+// Store macros configuration. Returns true on success
+bool Sequencer::store() const {
+  auto cfg_file = System::fs.open(MACROS_CFG_NAME, "w");
+  if (!cfg_file)
+    return false;
+
+  String cfg;
+  for (const auto& macro : macros) {
+    cfg += macro.name;
+    cfg += '\t';
+    cfg += macro.script;
+    cfg += '\n';
+  }
+  const auto ret = cfg_file.print(cfg) == cfg.length();
+  cfg_file.close();
+  return ret;
+}
+
+// Save new macros configuration from web arguments. Returns true on success
+//// Web arguments: "del=<name>" to delete a macro; "macro=<name>&script=<steps>" to define one.
+//// Only the sequences running the deleted or redefined macro are stopped; those running macros after a deleted one are renumbered
+bool Sequencer::save() {
+  auto& web_server = System::web_server;
+
+  if (web_server.hasArg("del")) {
+    const auto name = web_server.arg("del");
+    for (uint8_t m = 0; m < macros.size(); m++)
+      if (macros[m].name == name) {
+        for (uint8_t i = 0; i < SEQUENCES_MAX; i++)
+          if (sequences[i].macro == m)
+            stop(i);
+          else
+          if (sequences[i].macro > m)
+            sequences[i].macro--;
+        System::removeTimerAction(String(F("macro ")) + name);
+        macros.erase(macros.begin() + m);
+        break;
+      }
+  } else
+
+  if (web_server.hasArg("macro")) {
+    Macro macro;
+    macro.name = web_server.arg("macro");
+    macro.name.trim();
+    macro.script = web_server.arg("script");
+    macro.script.trim();
+    if (!BulbManager::isValidName(macro.name) || macro.script.indexOf('\t') != -1 || macro.script.indexOf('\n') != -1 || !compile(macro))
+      return false;
+
+    auto existing = false;
+    for (uint8_t m = 0; m < macros.size(); m++)
+      if (macros[m].name == macro.name) {
+        for (uint8_t i = 0; i < SEQUENCES_MAX; i++)
+          if (sequences[i].macro == m)
+            stop(i);
+        macros[m] = macro;
+        existing = true;
+        break;
+      }
+    if (!existing) {
+      if (macros.size() >= MACROS_MAX)
+        return false;
+      addTimerAction(macro.name);
+      macros.push_back(macro);
+    }
+  } else
+    return false;
+
+  return store();
+}
+
+// Print macros configuration controls in HTML
+void Sequencer::printHTML(String &page) const {
+  page += F("<p>Macros:<br/>\n");
+  for (const auto& macro : macros) {
+    page += macro.name;
+    page += F(": <code>");
+    page += macro.script;
+    page += F("</code> [<a href=\"/?macro=");
+    page += BulbManager::urlName(macro.name);
+    page += F("\">run</a>|<a href=\"/macros-save?del=");
+    page += BulbManager::urlName(macro.name);
+    page += F("\">delete</a>]<br/>\n");
+  }
+  if (macros.empty())
+    page += F("<i>none</i><br/>\n");
+  page += F("</p>\n<form action=\"/macros-save\">\n<p>Macro <input type=\"text\" name=\"macro\" size=\"10\"/>"
+    " steps <input type=\"text\" name=\"script\" size=\"40\" placeholder=\"on; wait 2s; ct 2700; wait 10m; off\"/>"
+    " <input type=\"submit\" value=\"Save macro\"/><br/>\n"
+    "<i>Steps: on, off, flip, bright &lt;%&gt;, ct &lt;K&gt;, rgb &lt;RRGGBB&gt;, wait &lt;N&gt;s|m|h; separated by ';'</i></p>\n</form>\n");
+}
+
+// Define a singleton-like instance
+Sequencer sequencer;                       // Global macro sequencer
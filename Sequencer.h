@@ -0,0 +1,67 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Macro sequencer definitions
+ * (c) DNS 2021
+ */
+
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <vector>                          // Dynamic array
+#include <Arduino.h>                       // String
+
+class Sequencer {
+
+  public:
+
+    typedef enum Op { OP_ON, OP_OFF, OP_FLIP, OP_BRIGHT, OP_CT, OP_RGB, OP_WAIT, OP_INVALID } op_t; // Macro step operations
+
+    // Macro step
+    struct Step {
+      op_t op;                             // Operation
+      uint32_t arg;                        // Argument (brightness %, color temperature K, color 0xRRGGBB or wait duration ms)
+    };
+
+    // Named macro
+    struct Macro {
+      String name;                         // Macro name
+      String script;                       // Source text, e.g. "on; wait 2s; ct 2700; wait 10m; off"
+      std::vector<Step> steps;             // Compiled steps
+    };
+
+    static const uint8_t SEQUENCES_MAX = 4;  // Maximum number of macros running at the same time
+    static const uint8_t MACROS_MAX = INT8_MAX;  // Maximum number of macros (they are numbered with int8_t)
+
+  protected:
+
+    // Running macro
+    struct Sequence {
+      int8_t macro;                        // Macro number (-1 = slot is free)
+      uint8_t step;                        // Next step
+      unsigned long t_next;                // Time to execute the next step (ms)
+    };
+
+    std::vector<Macro> macros;             // Macros
+    Sequence sequences[SEQUENCES_MAX];     // Sequence pool
+
+    static const char *MACROS_CFG_NAME;    // Macros configuration file
+
+    static bool compile(Macro&);           // Compile macro script into steps. Returns true on success
+    bool store() const;                    // Store macros configuration. Returns true on success
+    void stop(const uint8_t);              // Stop sequence in a given slot
+    static void addTimerAction(const String&); // Offer macro as a timer action
+
+  public:
+
+    Sequencer();                           // Constructor
+    void begin();                          // Start operation (load macros)
+    void update();                         // Background processing (run sequences)
+    bool start(const String&, const String& reason = ""); // Start a macro by name. Returns true on success
+    bool save();                           // Save new macros configuration from web arguments. Returns true on success
+    bool isRunning() const;                // True if some macro is running
+    void printHTML(String &) const;        // Print macros configuration controls in HTML
+};
+
+// Declare a singleton-like instance
+extern Sequencer sequencer;                // Global macro sequencer
+
+#endif // SEQUENCER_H
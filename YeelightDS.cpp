@@ -24,24 +24,30 @@ static const char *YL_MSG_DISCOVER PROGMEM =
   "MAN: \"ssdp:discover\"\r\n"
   "ST: wifi_bulb";
 
-static const char *YL_MSG_TOGGLE PROGMEM =
-  "{\"id\":1,"
-   "\"method\":\"toggle\","
-   "\"params\":[]"
-  "}\r\n";
+// Method names, in order of ymethod_t
+static const char *YL_METHOD_NAMES[] PROGMEM = {
+  "get_prop", "set_default", "set_power", "toggle", "set_bright", "start_cf", "stop_cf", "set_scene",
+  "cron_add", "cron_get", "cron_del", "set_ct_abx", "set_rgb", "set_hsv", "set_adjust",
+  "adjust_bright", "adjust_ct", "adjust_color", "set_music", "set_name"
+};
+
+// Property names, in order of yprop_t
+static const char *YL_PROP_NAMES[] PROGMEM = {
+  "power", "bright", "ct", "rgb", "hue", "sat", "color_mode"
+};
 
 /////////////////////// YBulb ///////////////////////
 
-WiFiClient YBulb::client;       // Wi-Fi client (shared across all bulbs)
 const char *YBulb::ID_UNKNOWN PROGMEM = "0x000000000UNKNOWN";  // Unknown ID literal
 
 // Constructor (bulb ID, bulb IP, bulb port)
 YBulb::YBulb(const String& yid, const IPAddress& yip, const uint16_t yport) :
-  id(yid), ip(yip), port(yport), power(false), active(false) {
+  id(yid), ip(yip), port(yport), power(false), active(false), state({0, 0, 0, 0, 0, YL_MODE_UNKNOWN}), support(SUPPORT_ALL),
+  refreshing(false), t_refresh(0), tokens(QUOTA_BURST), t_tokens(0), n_sent(0), n_queued(0), n_coalesced(0), n_rejected(0),
+  reachable(true), t_unreachable(0), journal_head(0), journal_len(0), armed(false), armed_power(false), t_fire(0) {
 
   // Reduce connection timeout for inactive bulbs
-  if (client.getTimeout() != TIMEOUT)
-    client.setTimeout(TIMEOUT);
+  client.setTimeout(TIMEOUT);
 }
 
 // Return shortened bulb ID
@@ -52,27 +58,483 @@ String YBulb::getShortID() const {
 
 // Turn the bulb on. Returns true on success
 bool YBulb::turnOn() {
-  return power ? true /* already on */ : flip();
+  return power ? true /* already on */ : setPowerState(true);
 }
 
 // Turn the bulb off. Returns true on success
 bool YBulb::turnOff() {
-  return power ? flip() : true /* already off */;
+  return power ? setPowerState(false) : true /* already off */;
+}
+
+// Send explicit power state to the bulb. Returns true on success
+//// Unlike toggle, explicit state cannot be misinterpreted if our idea of bulb state is outdated. Toggle is used as a fallback
+//// If the state cannot be delivered, it is recorded for replay()
+bool YBulb::setPowerState(const bool new_power) {
+  const auto ret = supports(YL_METHOD_SET_POWER) ?
+    command(YL_METHOD_SET_POWER, String(new_power ? F("\"on\"") : F("\"off\"")) + transition(300)) :
+    power == new_power || command(YL_METHOD_TOGGLE);
+  if (ret) {
+    power = new_power;
+    journal_len = 0;          // Superseded
+  } else
+    record(new_power);
+  return ret;
 }
 
 // Toggle bulb power state. Returns true on success
 bool YBulb::flip() {
-  if (client.connect(ip, port)) {
-    client.print(FPSTR(YL_MSG_TOGGLE));
-    client.stop();
+  if (command(YL_METHOD_TOGGLE)) {
     power = !power;
+    journal_len = 0;
+    return true;
+  } else {
+    record(!power);           // Toggle is not safe to replay; the intended state is
+    return false;
+  }
+}
+
+// Send a command to the bulb. Returns true on success (including delayed sending)
+//// Methods not supported by the bulb are not sent and reported as failures
+bool YBulb::command(const ymethod_t method, const String& params, const yquota_t policy) {
+  if (!supports(method))
+    return false;
+
+  return submit(method, message(method, params), policy);
+}
+
+// Set brightness (1..100 %) with a smooth transition of a given duration (ms; 0 = sudden). Returns true on success
+bool YBulb::setBright(const uint8_t bright, const uint16_t duration) {
+  const auto new_bright = constrain(bright, (uint8_t)1, (uint8_t)100);
+  String params;
+  params += new_bright;
+  params += transition(duration);
+  if (command(YL_METHOD_SET_BRIGHT, params, YL_QUOTA_COALESCE)) {
+    state.bright = new_bright;
+    return true;
+  } else
+    return false;
+}
+
+// Set color temperature (1700..6500 K) with a smooth transition. Returns true on success
+bool YBulb::setCT(const uint16_t ct, const uint16_t duration) {
+  const auto new_ct = constrain(ct, (uint16_t)1700, (uint16_t)6500);
+  String params;
+  params += new_ct;
+  params += transition(duration);
+  if (command(YL_METHOD_SET_CT_ABX, params, YL_QUOTA_COALESCE)) {
+    state.ct = new_ct;
+    state.mode = YL_MODE_CT;
+    return true;
+  } else
+    return false;
+}
+
+// Set color (0xRRGGBB) with a smooth transition. Returns true on success
+bool YBulb::setRGB(const uint32_t rgb, const uint16_t duration) {
+  String params;
+  params += rgb & 0xffffff;
+  params += transition(duration);
+  if (command(YL_METHOD_SET_RGB, params, YL_QUOTA_COALESCE)) {
+    state.rgb = rgb & 0xffffff;
+    state.mode = YL_MODE_RGB;
+    return true;
+  } else
+    return false;
+}
+
+// Program bulb's own timer to turn it off in a given number of minutes (0 = cancel). Returns true on success
+//// The bulb keeps the timer even if the switch goes away. Timer type 0 is the only one defined ("power off")
+bool YBulb::setOffTimer(const uint16_t minutes) {
+  if (!minutes)
+    return command(YL_METHOD_CRON_DEL, F("0"));
+  String params(F("0,"));
+  params += minutes;
+  return command(YL_METHOD_CRON_ADD, params);
+}
+
+// Compose transition parameters for a command (duration in ms; 0 = sudden)
+String YBulb::transition(const uint16_t duration) {
+  String params(duration ? F(",\"smooth\",") : F(",\"sudden\","));
+  params += duration ? (duration > TRANSITION_MIN ? duration : TRANSITION_MIN) : 0;
+  return params;
+}
+
+// Compose color flow parameters ramping to a given brightness (%) and color temperature (K) over a duration (ms)
+//// Parameters suit "start_cf", or "set_scene" after a leading "cf". The bulb runs the flow by itself; optionally, the flow starts from the lowest brightness.
+//// Format: count, action, "duration, mode (2 = color temperature), value, brightness, ...". Count is the number of steps to run, so it covers the dim step too
+String YBulb::ramp(const uint32_t duration, const uint8_t bright, const uint16_t ct, const yflow_t end, const bool from_dim) {
+  static const uint16_t FLOW_STEP_MIN = 50;     // Minimum flow step duration accepted by bulbs (ms)
+
+  String params;
+  params += from_dim ? 2 : 1;
+  params += ',';
+  params += (int)end;
+  params += F(",\"");
+  if (from_dim) {
+    params += FLOW_STEP_MIN;
+    params += F(",2,");
+    params += ct;
+    params += F(",1,");
+  }
+  params += duration > FLOW_STEP_MIN ? duration : FLOW_STEP_MIN;
+  params += F(",2,");
+  params += ct;
+  params += ',';
+  params += constrain(bright, (uint8_t)1, (uint8_t)100);
+  params += '"';
+  return params;
+}
+
+// Send prepared command message(s) to the bulb. Returns true on success (including delayed sending)
+//// Messages sent this way are never coalesced, as they may contain several commands
+bool YBulb::send(const String& msg, const yquota_t policy) {
+  return submit(YL_METHOD_INVALID, msg, policy == YL_QUOTA_COALESCE ? YL_QUOTA_QUEUE : policy);
+}
+
+// Connect to the bulb. Returns true on success
+bool YBulb::connect() {
+  reachable = client.connect(ip, port);
+  if (!reachable)
+    t_unreachable = millis();
+  return reachable;
+}
+
+// Record an intended power state which could not be delivered
+//// The journal is bounded; the oldest intents are overwritten
+void YBulb::record(const bool new_power) {
+  journal[journal_head] = {new_power, millis()};
+  journal_head = (journal_head + 1) % JOURNAL_SIZE;
+  if (journal_len < JOURNAL_SIZE)
+    journal_len++;
+}
+
+// True if there is an undelivered intent worth replaying
+bool YBulb::hasIntent() const {
+  return journal_len && millis() - journal[(journal_head + JOURNAL_SIZE - 1) % JOURNAL_SIZE].t < INTENT_TTL;
+}
+
+// Apply the latest undelivered intent and clear the journal. Returns true on success
+//// Only the final state matters, so intermediate intents are skipped. Power state should be fresh for this to work
+bool YBulb::replay() {
+  if (!hasIntent()) {
+    journal_len = 0;
     return true;
+  }
+  const auto new_power = journal[(journal_head + JOURNAL_SIZE - 1) % JOURNAL_SIZE].power;
+  journal_len = 0;
+  return power == new_power || setPowerState(new_power);
+}
+
+// Prepare sending power state (true = "on"): connect and send all but the command terminator. Returns true on success (including delayed sending)
+//// The bulb does not act until the line is complete, so several bulbs can be prepared in advance and then fired together.
+//// If the quota does not allow sending right now, the command is delayed the usual way and there is nothing to fire
+bool YBulb::arm(const bool new_power) {
+  static const uint8_t TERMINATOR_LENGTH = 2;   // "\r\n"
+
+  armed = false;
+  const auto method = supports(YL_METHOD_SET_POWER) ? YL_METHOD_SET_POWER : YL_METHOD_TOGGLE;
+  if (!supports(method))
+    return false;
+  if (!pending.empty() || !takeTokens(1))
+    return setPowerState(new_power);
+
+  refreshing = false;             // Command takes over the connection; pending refresh, if any, is abandoned
+  if (!connect()) {
+    record(new_power);
+    return false;
+  }
+  client.setNoDelay(true);        // Do not let the TCP stack hold back small writes
+  const auto msg = message(method, method == YL_METHOD_SET_POWER ? String(new_power ? F("\"on\"") : F("\"off\"")) + transition(300) : String());
+  client.write((const uint8_t *)msg.c_str(), msg.length() - TERMINATOR_LENGTH);
+  armed = true;
+  armed_power = new_power;
+  return true;
+}
+
+// Complete the prepared command (as fast as possible). Returns true on success
+//// Power state is assumed reached; the connection is left open for release(), as closing it may take time
+bool YBulb::fire() {
+  if (!armed)
+    return false;
+  armed = false;
+  const auto ret = client.write((const uint8_t *)"\r\n", 2) == 2;
+  t_fire = micros();
+  if (ret) {
+    power = armed_power;
+    journal_len = 0;
+    n_sent++;
   } else
+    record(armed_power);
+  return ret;
+}
+
+// Close connection after fire()
+void YBulb::release() {
+  armed = false;
+  client.stop();
+}
+
+// Send or delay a message according to the quota. Returns true on success
+//// Bulbs silently ignore commands above about 60 per minute per connection (144 in total), so the switch keeps below that.
+//// Commands go out in order: once some are delayed, new ones wait behind them
+bool YBulb::submit(const ymethod_t method, const String& msg, const yquota_t policy) {
+  if (pending.empty() && takeTokens(countCommands(msg)))
+    return transmit(msg);
+
+  switch (policy) {
+    case YL_QUOTA_COALESCE:
+      for (auto& cmd : pending)
+        if (cmd.first == method) {
+          cmd.second = msg;
+          n_coalesced++;
+          return true;
+        }
+      // Fall through
+
+    case YL_QUOTA_QUEUE:
+      if (pending.size() < QUEUE_MAX) {
+        pending.emplace_back(method, msg);
+        n_queued++;
+        return true;
+      }
+      // Fall through
+
+    default:
+      n_rejected++;
+      return false;
+  }
+}
+
+// Send commands delayed by the quota, as far as it allows. Returns true while some are pending
+bool YBulb::update() {
+  while (!pending.empty()) {
+    if (!takeTokens(countCommands(pending.front().second)))
+      break;
+    transmit(pending.front().second);     // If the bulb is gone, there is nobody to report to; the next state refresh will tell
+    pending.erase(pending.begin());
+  }
+  return !pending.empty();
+}
+
+// Consume quota tokens, if available. Returns true on success
+//// Tokens are refilled lazily, based on the time elapsed since the last refill
+bool YBulb::takeTokens(const uint8_t n) {
+  const auto now = millis();
+  const auto refill = (now - t_tokens) / QUOTA_REFILL;
+  if (refill) {
+    tokens = tokens + refill < QUOTA_BURST ? tokens + refill : QUOTA_BURST;
+    t_tokens = tokens == QUOTA_BURST ? now : t_tokens + refill * QUOTA_REFILL;
+  }
+  if (tokens >= n)
+    tokens -= n;
+  else
+  if (tokens == QUOTA_BURST)
+    tokens = 0;       // Message larger than the burst can only go with a full bucket
+  else
+    return false;
+  return true;
+}
+
+// Return number of commands in a message (one per line)
+uint8_t YBulb::countCommands(const String& msg) {
+  uint8_t ncmd = 0;
+  for (auto pos = msg.indexOf('\n'); pos != -1; pos = msg.indexOf('\n', pos + 1))
+    ncmd++;
+  return ncmd;
+}
+
+// Transmit a message to the bulb right away. Returns true on success
+bool YBulb::transmit(const String& msg) {
+  refreshing = false;             // Command takes over the connection; pending refresh, if any, is abandoned
+  if (!connect())
+    return false;
+
+  client.print(msg);
+  client.stop();
+  n_sent++;
+  return true;
+}
+
+// Compose a bulb command message
+String YBulb::message(const ymethod_t method, const String& params, const uint8_t msg_id) {
+  String msg(F("{\"id\":"));
+  msg += msg_id;
+  msg += F(",\"method\":\"");
+  msg += YL_METHOD_NAMES[method];
+  msg += F("\",\"params\":[");
+  msg += params;
+  msg += F("]}\r\n");
+  return msg;
+}
+
+// Request bulb state refresh (non-blocking after connection). Returns true if request was sent
+//// All tracked properties are requested at once; the reply is collected by receiveState().
+//// A failed connection blocks for up to TIMEOUT, so a bulb which is not reachable is only retried every RETRY_INTERVAL
+bool YBulb::requestState() {
+  static const uint8_t GET_PROP_MSG_ID = 2;     // Distinguishes the reply from notifications
+
+  refreshing = false;
+  if (!reachable && millis() - t_unreachable < RETRY_INTERVAL)
     return false;
+  if (!supports(YL_METHOD_GET_PROP) || isThrottled() || !takeTokens(1) || !connect())
+    return false;     // Refresh is not worth a command slot when the quota is short; it will be retried later
+
+  String params;
+  for (uint8_t prop = 0; prop < YL_PROP_INVALID; prop++) {
+    if (prop)
+      params += ',';
+    params += '"';
+    params += YL_PROP_NAMES[prop];
+    params += '"';
+  }
+  client.print(message(YL_METHOD_GET_PROP, params, GET_PROP_MSG_ID));
+  reply_line = "";
+  refreshing = true;
+  t_refresh = millis();
+  return true;
+}
+
+// Poll for bulb state refresh reply. Returns true while refresh is pending; sets 'changed' if the state changed
+//// Reply format: {"id":2,"result":["on","100","4000","16711680","100","35","2"]}. Values come in order of yprop_t.
+//// Only the bytes already received are read, so a partial line never blocks; it is completed on the next call
+bool YBulb::receiveState(bool& changed) {
+  if (!refreshing)
+    return false;
+
+  while (client.available()) {
+    const auto c = client.read();
+    if (c != '\n') {
+      if (c >= 0 && reply_line.length() < REPLY_LINE_MAX)
+        reply_line += (char)c;
+      continue;
+    }
+    const auto reply = reply_line;
+    reply_line = "";
+    auto pos = reply.indexOf(F("\"result\":["));
+    if (pos == -1)
+      continue;     // Not our reply (e.g., a "props" notification)
+
+    const auto old_power = power;
+    const auto old_state = state;
+    for (uint8_t prop = 0; prop < YL_PROP_INVALID; prop++) {
+      const auto start = reply.indexOf('"', pos + 1);
+      const auto end = start == -1 ? -1 : reply.indexOf('"', start + 1);
+      if (end == -1)
+        break;
+      if (end > start + 1)       // Properties not applicable to the model are returned as empty strings
+        setProp((yprop_t)prop, reply.substring(start + 1, end));
+      pos = end + 1;
+    }
+    changed = power != old_power || state != old_state;
+    refreshing = false;
+    reachable = true;
+    break;
+  }
+
+  if (refreshing && millis() - t_refresh >= TIMEOUT) {
+    refreshing = false;       // Bulb is not answering; keep the old state
+    reachable = false;
+    t_unreachable = millis();
+  }
+  if (!refreshing) {
+    client.stop();
+    reply_line = "";
+  }
+  return refreshing;
+}
+
+// Set bulb property from its string value
+void YBulb::setProp(const yprop_t prop, const String& value) {
+  switch (prop) {
+    case YL_PROP_POWER:      setPower(value);                            break;
+    case YL_PROP_BRIGHT:     state.bright = value.toInt();               break;
+    case YL_PROP_CT:         state.ct = value.toInt();                   break;
+    case YL_PROP_RGB:        state.rgb = value.toInt() & 0xffffff;       break;
+    case YL_PROP_HUE:        state.hue = value.toInt();                  break;
+    case YL_PROP_SAT:        state.sat = value.toInt();                  break;
+    case YL_PROP_COLOR_MODE: state.mode = value.toInt() <= YL_MODE_HSV ? value.toInt() : YL_MODE_UNKNOWN; break;
+    default: ;
+  }
+}
+
+// Set bulb property from its name and string value. Unknown properties are ignored
+void YBulb::setProp(const String& name, const String& value) {
+  for (uint8_t prop = 0; prop < YL_PROP_INVALID; prop++)
+    if (name == YL_PROP_NAMES[prop]) {
+      setProp((yprop_t)prop, value);
+      break;
+    }
+}
+
+// Set supported methods from a space-separated list of method names
+//// Methods unknown to the switch (e.g., "bg_*" for ceiling lights) are ignored
+void YBulb::setSupport(const String& methods) {
+  support = 0;
+  int start = 0;
+  while (start < (int)methods.length()) {
+    auto end = methods.indexOf(' ', start);
+    if (end == -1)
+      end = methods.length();
+    const auto method = methods.substring(start, end);
+    for (uint8_t m = 0; m < YL_METHOD_INVALID; m++)
+      if (method == YL_METHOD_NAMES[m]) {
+        support |= 1UL << m;
+        break;
+      }
+    start = end + 1;
+  }
+}
+
+// Return bulb light state as string
+String YBulb::getLightStr() const {
+  String str;
+  if (!state.bright)
+    return F("-");    // Not reported
+  str += state.bright;
+  str += '%';
+  switch (state.mode) {
+    case YL_MODE_CT:
+      str += F(", ");
+      str += state.ct;
+      str += 'K';
+      break;
+
+    case YL_MODE_RGB: {
+      char rgb_str[sizeof(", #RRGGBB")];
+      snprintf(rgb_str, sizeof(rgb_str), ", #%06lX", (unsigned long)(state.rgb & 0xffffff));
+      str += rgb_str;
+      break;
+    }
+
+    case YL_MODE_HSV:
+      str += F(", hue ");
+      str += state.hue;
+      str += F(", sat ");
+      str += state.sat;
+      str += '%';
+      break;
+
+    default: ;
+  }
+  return str;
+}
+
+// Return command quota statistics as string
+String YBulb::getQuotaStr() const {
+  String str;
+  str += n_sent;
+  str += F(" sent, ");
+  str += n_queued;
+  str += F(" delayed, ");
+  str += n_coalesced;
+  str += F(" coalesced, ");
+  str += n_rejected;
+  str += F(" rejected");
+  return str;
 }
 
 // Print bulb info in HTML
-//// Name | ID (shortened) | IP Address | Model | Power
+//// Name | ID (shortened) | IP Address | Model | Power | Light
 void YBulb::printHTML(String& str) const {
   str += F("<td>");
   str += name;
@@ -84,12 +546,16 @@ void YBulb::printHTML(String& str) const {
   str += model;
   str += F("</td><td>");
   str += getPowerStr();
+  str += F("</td><td>");
+  str += getLightStr();
   str += F("</td>");
 }
 
 // Print bulb status in HTML
 void YBulb::printStatusHTML(String& str) const {
-  str += F("<tr>");
+  str += F("<tr title=\"Commands: ");
+  str += getQuotaStr();
+  str += F("\">");
   printHTML(str);
   str += F("</tr>\n");
 }
@@ -181,8 +647,16 @@ YBulb *YDiscovery::receive() {
       if (line.startsWith(F("name: ")) && new_bulb)
         new_bulb->setName(line.substring(6));  // Currently, Yeelights always seem to return an empty name here :(
       else
-      if (line.startsWith(F("power: ")) && new_bulb)
-        new_bulb->setPower(line.substring(7));
+      if (line.startsWith(F("support: ")) && new_bulb)
+        new_bulb->setSupport(line.substring(9));
+      else
+      if (new_bulb) {
+
+        // Remaining properties ("power", "bright", "ct", ...) are all reported as "<name>: <value>"
+        const auto sep = line.indexOf(F(": "));
+        if (sep > 0)
+          new_bulb->setProp(line.substring(0, sep), line.substring(sep + 2));
+      }
     }
 
     if (!new_bulb)
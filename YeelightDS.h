@@ -8,15 +8,98 @@
 
 #include <WiFiClient.h>           // Wi-Fi support
 #include <WiFiUdp.h>              // UDP support
+#include <vector>                 // Command queue
 
 namespace ds {
 
+  // Yeelight methods. Position in this list is the bit number in the bulb capability mask
+  typedef enum {
+    YL_METHOD_GET_PROP,
+    YL_METHOD_SET_DEFAULT,
+    YL_METHOD_SET_POWER,
+    YL_METHOD_TOGGLE,
+    YL_METHOD_SET_BRIGHT,
+    YL_METHOD_START_CF,
+    YL_METHOD_STOP_CF,
+    YL_METHOD_SET_SCENE,
+    YL_METHOD_CRON_ADD,
+    YL_METHOD_CRON_GET,
+    YL_METHOD_CRON_DEL,
+    YL_METHOD_SET_CT_ABX,
+    YL_METHOD_SET_RGB,
+    YL_METHOD_SET_HSV,
+    YL_METHOD_SET_ADJUST,
+    YL_METHOD_ADJUST_BRIGHT,
+    YL_METHOD_ADJUST_CT,
+    YL_METHOD_ADJUST_COLOR,
+    YL_METHOD_SET_MUSIC,
+    YL_METHOD_SET_NAME,
+    YL_METHOD_INVALID                              // Unsupported method (must be the last)
+  } ymethod_t;
+
+  // Yeelight properties tracked by the switch
+  typedef enum {
+    YL_PROP_POWER,
+    YL_PROP_BRIGHT,
+    YL_PROP_CT,
+    YL_PROP_RGB,
+    YL_PROP_HUE,
+    YL_PROP_SAT,
+    YL_PROP_COLOR_MODE,
+    YL_PROP_INVALID                                // Unsupported property (must be the last)
+  } yprop_t;
+
+  // Yeelight color modes
+  typedef enum {
+    YL_MODE_UNKNOWN,
+    YL_MODE_RGB,
+    YL_MODE_CT,
+    YL_MODE_HSV
+  } ymode_t;
+
+  // Handling of commands exceeding the bulb command quota
+  typedef enum {
+    YL_QUOTA_QUEUE,                                // Delay the command until the quota allows sending it
+    YL_QUOTA_COALESCE,                             // Same, but replace a delayed command of the same method, if any
+    YL_QUOTA_REJECT                                // Drop the command
+  } yquota_t;
+
+  // Action after a color flow ends
+  typedef enum {
+    YL_FLOW_RECOVER,                               // Return to the state before the flow
+    YL_FLOW_STAY,                                  // Stay in the last flow state
+    YL_FLOW_OFF                                    // Turn off
+  } yflow_t;
+
+  // Intended bulb state, kept while the bulb is not reachable
+  struct YIntent {
+    bool power;                                    // Power state (true = "on")
+    unsigned long t;                               // Time of the intent (ms)
+  };
+
+  // Bulb light state (as reported by the bulb)
+  struct YBulbState {
+    uint32_t rgb;                                  // Color (0xRRGGBB)
+    uint16_t ct;                                   // Color temperature (K)
+    uint16_t hue;                                  // Hue (0..359)
+    uint8_t bright;                                // Brightness (1..100 %)
+    uint8_t sat;                                   // Saturation (0..100 %)
+    uint8_t mode;                                  // Color mode (ymode_t)
+
+    bool operator==(const YBulbState& ys) const {  // State comparison
+      return rgb == ys.rgb && ct == ys.ct && hue == ys.hue && bright == ys.bright && sat == ys.sat && mode == ys.mode;
+    }
+    bool operator!=(const YBulbState& ys) const {  // State comparison
+      return !(*this == ys);
+    }
+  };
+
   // Yeelight bulb object
   class YBulb {
 
     protected:
 
-      static WiFiClient client;                    // Wi-Fi client (shared across all bulbs)
+      WiFiClient client;                           // Wi-Fi client (one per bulb, so that bulbs can be queried in parallel)
 
       String id;                                   // Yeelight device ID
       IPAddress ip;                                // IP-address of the bulb
@@ -25,14 +108,49 @@ namespace ds {
       String model;                                // Bulb model ("color", "stripe", etc)
       bool power;                                  // Current power state (true = "on")
       bool active;                                 // True if the bulb is actively controlled (e.g., linked to a switch)
+      YBulbState state;                            // Current light state
+      uint32_t support;                            // Supported methods (bitmask of ymethod_t)
+      bool refreshing;                             // True if state refresh request is pending
+      unsigned long t_refresh;                     // State refresh request time (ms)
+      String reply_line;                           // State refresh reply line received so far
+      uint8_t tokens;                              // Commands which can be sent right now (token bucket)
+      unsigned long t_tokens;                      // Last token refill time (ms)
+      std::vector<std::pair<ymethod_t, String>> pending; // Commands delayed by the quota (method, message)
+      uint32_t n_sent;                             // Number of commands sent
+      uint32_t n_queued;                           // Number of commands delayed by the quota
+      uint32_t n_coalesced;                        // Number of delayed commands replaced by a newer one
+      uint32_t n_rejected;                         // Number of commands dropped because of the quota
+      bool reachable;                              // True if the bulb answered the last connection attempt
+      unsigned long t_unreachable;                 // Time the bulb last failed to answer (ms)
+      static const uint8_t JOURNAL_SIZE = 4;       // Maximum number of undelivered intents kept
+      YIntent journal[JOURNAL_SIZE];               // Intents which could not be delivered (ring buffer)
+      uint8_t journal_head;                        // Position of the next intent in the journal
+      uint8_t journal_len;                         // Number of intents in the journal
+      bool armed;                                  // True if a command is waiting for fire()
+      bool armed_power;                            // Power state the prepared command brings the bulb to
+      unsigned long t_fire;                        // Time the last armed command was fired (us)
 
       virtual void printHTML(String&) const;       // Print bulb info in HTML
+      virtual bool command(const ymethod_t, const String& params = "", const yquota_t policy = YL_QUOTA_QUEUE); // Send a command to the bulb. Returns true on success (including delayed sending)
+      virtual bool submit(const ymethod_t, const String&, const yquota_t); // Send or delay a message according to the quota. Returns true on success
+      virtual bool transmit(const String&);        // Transmit a message to the bulb right away. Returns true on success
+      virtual bool takeTokens(const uint8_t);      // Consume quota tokens, if available. Returns true on success
+      virtual bool connect();                      // Connect to the bulb. Returns true on success
+      virtual void record(const bool);             // Record an intended power state which could not be delivered
 
     public:
 
       static const size_t ID_LENGTH = 18;          // Length of the Yeelight device ID (chars)
       static const char *ID_UNKNOWN;               // Unknown ID literal
       static const uint16_t TIMEOUT = 1000;        // Bulb connection timeout (ms)
+      static const unsigned long RETRY_INTERVAL = 60000; // Interval between state refresh attempts of an unreachable bulb (ms)
+      static const uint16_t REPLY_LINE_MAX = 256;  // Longest reply line kept (chars); longer lines are truncated (they are notifications, not state replies)
+      static const uint32_t SUPPORT_ALL = 0xffffffff; // Capability mask of a bulb whose capabilities are unknown
+      static const uint16_t TRANSITION_MIN = 30;   // Minimum smooth transition duration accepted by bulbs (ms)
+      static const uint8_t QUOTA_BURST = 10;       // Commands which can be sent at once (token bucket size)
+      static const uint16_t QUOTA_REFILL = 1200;   // Token refill period (ms). With the burst, gives 60 commands per minute at most
+      static const uint8_t QUEUE_MAX = 8;          // Maximum number of delayed commands
+      static const unsigned long INTENT_TTL = 600000; // Intents older than this are not replayed (ms)
 
       YBulb(const String& yid = ID_UNKNOWN, const IPAddress& yip = 0, const uint16_t yport = 55443); // Constructor (bulb ID, bulb IP, bulb port)
       virtual ~YBulb() {}                          // Destructor
@@ -51,12 +169,49 @@ namespace ds {
       virtual String getPowerStr() const { return power ? F("on") : F("off"); } // Return bulb power state as string
       virtual void setPower(bool new_power) { power = new_power; }     // Set bulb power state (true = "on")
       virtual void setPower(const String& new_power) { power = new_power == F("on"); } // Set bulb power state from string ("on" or "off")
+      virtual const YBulbState& getState() const { return state; }     // Return bulb light state
+      virtual void setState(const YBulbState& ys) { state = ys; }      // Set bulb light state
+      virtual uint8_t getBright() const { return state.bright; }       // Return bulb brightness (%)
+      virtual uint16_t getCT() const { return state.ct; }  // Return bulb color temperature (K)
+      virtual uint32_t getRGB() const { return state.rgb; }            // Return bulb color (0xRRGGBB)
+      virtual ymode_t getColorMode() const { return (ymode_t)state.mode; } // Return bulb color mode
+      virtual void setProp(const yprop_t, const String&);  // Set bulb property from its string value
+      virtual void setProp(const String&, const String&);  // Set bulb property from its name and string value. Unknown properties are ignored
+      virtual bool supports(const ymethod_t method) const { return method < YL_METHOD_INVALID && support & 1UL << method; } // True if the bulb supports a method
+      virtual uint32_t getSupport() const { return support; }          // Return supported methods mask
+      virtual void setSupport(const String&);              // Set supported methods from a space-separated list of method names
+      virtual void setSupport(const uint32_t new_support) { support = new_support; } // Set supported methods mask
       virtual bool isActive() const { return active; }     // True if bulb control is active
       virtual void activate() { active = true; }           // Activate bulb control
       virtual void deactivate() { active = false; }        // Deactivate bulb control
       virtual bool turnOn();                               // Turn the bulb on. Returns true on success
       virtual bool turnOff();                              // Turn the bulb off. Returns true on success
       virtual bool flip();                                 // Toggle bulb power state. Returns true on success
+      virtual bool setPowerState(const bool);              // Send explicit power state to the bulb (true = "on"). Returns true on success
+      virtual bool setBright(const uint8_t, const uint16_t duration = 0);  // Set brightness (1..100 %) with a smooth transition of a given duration (ms; 0 = sudden). Returns true on success
+      virtual bool setCT(const uint16_t, const uint16_t duration = 0);     // Set color temperature (1700..6500 K) with a smooth transition. Returns true on success
+      virtual bool setRGB(const uint32_t, const uint16_t duration = 0);    // Set color (0xRRGGBB) with a smooth transition. Returns true on success
+      virtual bool setOffTimer(const uint16_t);            // Program bulb's own timer to turn it off in a given number of minutes (0 = cancel). Returns true on success
+      virtual bool send(const String&, const yquota_t policy = YL_QUOTA_QUEUE); // Send prepared command message(s) to the bulb. Returns true on success (including delayed sending)
+      virtual bool arm(const bool);                        // Prepare sending power state (true = "on"): connect and send all but the command terminator. Returns true on success (including delayed sending)
+      virtual bool fire();                                 // Complete the prepared command (as fast as possible). Returns true on success
+      virtual void release();                              // Close connection after fire()
+      virtual bool isArmed() const { return armed; }       // True if a command is prepared
+      virtual unsigned long getFireTime() const { return t_fire; } // Return time the last prepared command was completed (us)
+      virtual bool isReachable() const { return reachable; } // True if the bulb answered the last connection attempt
+      virtual bool hasIntent() const;                      // True if there is an undelivered intent worth replaying
+      virtual bool replay();                               // Apply the latest undelivered intent and clear the journal. Returns true on success
+      virtual bool update();                               // Send commands delayed by the quota, as far as it allows. Returns true while some are pending
+      virtual bool isThrottled() const { return !pending.empty(); } // True if some commands are delayed by the quota
+      virtual String getQuotaStr() const;                  // Return command quota statistics as string
+      static String message(const ymethod_t, const String& params = "", const uint8_t msg_id = 1); // Compose a bulb command message
+      static String transition(const uint16_t duration);   // Compose transition parameters for a command (duration in ms; 0 = sudden)
+      static uint8_t countCommands(const String&);         // Return number of commands in a message
+      static String ramp(const uint32_t duration, const uint8_t bright, const uint16_t ct, const yflow_t end = YL_FLOW_STAY, const bool from_dim = false); // Compose color flow parameters ramping to a given brightness (%) and color temperature (K) over a duration (ms)
+      virtual bool requestState();                         // Request bulb state refresh (non-blocking after connection). Returns true if request was sent
+      virtual bool receiveState(bool& changed);            // Poll for bulb state refresh reply. Returns true while refresh is pending; sets 'changed' if the state changed
+      virtual bool isRefreshing() const { return refreshing; } // True if state refresh is pending
+      virtual String getLightStr() const;                  // Return bulb light state as string
       virtual void printStatusHTML(String&) const;         // Print bulb status in HTML
       virtual void printConfHTML(String&, uint8_t) const;  // Print bulb configuration controls in HTML
       virtual bool operator==(const String& id2) const {   // Bulb comparison
@@ -74,7 +229,7 @@ namespace ds {
 
       static const IPAddress SSDP_MULTICAST_ADDR;  // Yeelight is using a flavor of SSDP protocol
       static const uint16_t SSDP_PORT;             // ... but the port is different from standard
-      static const size_t SSDP_BUFFER_SIZE = 512;  // With contemporary bulbs, the reply is about 500 bytes
+      static const size_t SSDP_BUFFER_SIZE = 640;  // With contemporary bulbs, the reply is about 500 bytes; leave some room for longer "support" lists
       static const unsigned long TIMEOUT = 3000;   // Discovery timeout (ms)
 
     protected:
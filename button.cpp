@@ -4,16 +4,48 @@
  */
 
 #include "MySystem.h"                      // System-level definitions
+#include "BulbManager.h"                   // Bulb manager
 
 using namespace ds;
 using namespace ace_button;
 
 auto button_pressed = false;               // Button flag
+auto button_held = false;                  // Button hold flag (dimming)
 
 // Button handler
+//// With dimming enabled, a press is only known to be short on release; holding starts dimming instead
 void handleButtonEvent(AceButton* /* button */, uint8_t eventType, uint8_t /* buttonState */) {
+#ifdef BUTTON_DIMMING_DELAY
+  switch (eventType) {
+    case AceButton::kEventRepeatPressed:
+      button_held = true;
+      break;
+
+    case AceButton::kEventReleased:
+      if (button_held)
+        button_held = false;
+      else
+        button_pressed = true;
+      break;
+  }
+#else
   button_pressed = eventType == AceButton::kEventPressed;
+#endif // BUTTON_DIMMING_DELAY
+}
+
+#ifdef BUTTON_DIMMING_DELAY
+// Button initialization
+//// Repeated press events drive dimming. Long press (Wi-Fi configuration) is not affected
+void initButton() {
+  auto config = System::button.getButtonConfig();
+  config->setFeature(ButtonConfig::kFeatureRepeatPress);
+  config->setRepeatPressDelay(BUTTON_DIMMING_DELAY);
+  config->setRepeatPressInterval(BulbManager::DIM_INTERVAL);
 }
 
+// Install handler
+void (*System::onButtonInit)() = initButton;
+#endif // BUTTON_DIMMING_DELAY
+
 // Install handler
 void (*System::onButtonPress)(AceButton*, uint8_t, uint8_t) = handleButtonEvent;
@@ -13,6 +13,7 @@
 
 #include "MySystem.h"                      // System-level definitions
 #include "BulbManager.h"                   // Bulb manager
+#include "Sequencer.h"                     // Macro sequencer
 
 using namespace ds;
 
@@ -24,12 +25,14 @@ const char *System::hostname    PROGMEM = DS_HOSTNAME;
 
 // Global variables
 extern bool button_pressed;               // Button flag
+extern bool button_held;                  // Button hold flag (dimming)
 
 // Program setup
 void setup() {
 
   System::begin();
   bulb_manager.begin();
+  sequencer.begin();
 }
 
 // Program loop
@@ -40,7 +43,17 @@ void loop() {
     button_pressed = false;
     bulb_manager.processEvent(BulbManager::EVENT_FLIP, "Button pressed");
   }
+  static auto button_was_held = false;
+  if (button_held != button_was_held) {
+    button_was_held = button_held;
+    if (button_held)
+      bulb_manager.startDimming();
+    else
+      bulb_manager.stopDimming("Button held");
+  }
 
   // Background processing
+  bulb_manager.update();
+  sequencer.update();
   System::update();
 }
@@ -2,7 +2,11 @@
  * (c) DNS 2020-2021
  */
 
+#ifdef DS_SYSTEM_CONFIG
+#include DS_SYSTEM_CONFIG       // Read the capabilities from an alternative configuration (e.g., host simulation)
+#else
 #include "../MySystem.h"        // Read the defined capabilities
+#endif // DS_SYSTEM_CONFIG
 
 using namespace ds;
 
@@ -150,12 +154,101 @@ uint32 System::getResetReason() {
 // API inspired by NodeMCU Lua 'rtcmem' module
 // Read 'num' 4 bytes slots from RTC memory offset 'idx' into 'result'
 bool System::getRTCMem(uint32_t* result, const uint8_t idx, const uint8_t num) {
-  return ESP.rtcUserMemoryRead(idx * sizeof(uint32_t), result, num * sizeof(uint32_t));
+  return ESP.rtcUserMemoryRead(idx, result, num * sizeof(uint32_t));    // The offset is counted in 4 bytes blocks
 }
 
 // Store 'num' 4 bytes slots into RTC memory offset 'idx' from 'source'
 bool System::setRTCMem(const uint32_t* source, const uint8_t idx, const uint8_t num) {
-  return ESP.rtcUserMemoryWrite(idx * sizeof(uint32_t), const_cast<uint32_t *>(source), num * sizeof(uint32_t));
+  return ESP.rtcUserMemoryWrite(idx, const_cast<uint32_t *>(source), num * sizeof(uint32_t));
+}
+
+#include <coredecls.h>       // crc32()
+#ifdef DS_CAP_SYS_TIME
+#include <sys/time.h>        // settimeofday()
+#endif // DS_CAP_SYS_TIME
+#ifdef DS_CAP_SYS_NETWORK
+#include <ESP8266WiFi.h>     // WiFi object
+#endif // DS_CAP_SYS_NETWORK
+
+static const uint32_t RTC_SNAPSHOT_MAGIC = 0x54525344;  // "DSRT"
+
+// System state kept in RTC memory across warm resets
+struct RTCSnapshot {
+  uint32_t magic;                          // Snapshot signature
+  uint32_t time;                           // System time when stored (s; 0 = time not known)
+  uint32_t time_us;                        // Fraction of a second of the above (us)
+  uint32_t time_sync_time;                 // Last time the time was synchronized
+  uint32_t rtc_time;                       // RTC counter when stored (ticks)
+  uint32_t rtc_cali;                       // RTC tick period (us in Q12 fixed point); this is the drift estimate of the RTC clock
+  uint8_t channel;                         // Wi-Fi channel (0 = not known)
+  uint8_t bssid[6];                        // Wi-Fi access point MAC address
+  uint8_t reserved;                        // Reserved
+  uint32_t crc;                            // Checksum of the above
+};
+static_assert(sizeof(RTCSnapshot) == DS_RTCMEM_SLOTS_SYS * sizeof(uint32_t), "RTC snapshot does not fit its slots");
+
+static RTCSnapshot rtc_snapshot;           // Last snapshot stored or recovered
+bool System::warm_start = false;
+
+// Return true if the system state was recovered from RTC memory after a warm reset
+bool System::isWarmStart() {
+  return warm_start;
+}
+
+// Recover system state from RTC memory after a warm reset. Returns true on success
+//// Only software, watchdog and exception resets are considered warm; RTC memory and RTC counter do not survive power loss or external reset.
+//// Time is advanced by the RTC counter ticks elapsed since the snapshot, scaled with the RTC clock calibration stored with it
+bool System::loadRTCSnapshot() {
+  const auto reason = ESP.getResetInfoPtr()->reason;
+  if (reason != REASON_SOFT_RESTART && reason != REASON_WDT_RST && reason != REASON_EXCEPTION_RST && reason != REASON_SOFT_WDT_RST)
+    return false;
+  if (!getRTCMem(reinterpret_cast<uint32_t *>(&rtc_snapshot), DS_RTCMEM_SLOT_SYS, DS_RTCMEM_SLOTS_SYS)
+    || rtc_snapshot.magic != RTC_SNAPSHOT_MAGIC || rtc_snapshot.crc != crc32(&rtc_snapshot, offsetof(RTCSnapshot, crc))) {
+    memset(&rtc_snapshot, 0, sizeof(rtc_snapshot));
+    return false;
+  }
+  warm_start = true;
+
+#ifdef DS_CAP_SYS_TIME
+  if (rtc_snapshot.time) {
+    const uint64_t us = rtc_snapshot.time_us + (((uint64_t)(system_get_rtc_time() - rtc_snapshot.rtc_time) * rtc_snapshot.rtc_cali) >> 12);
+    const struct timeval tv = {(time_t)(rtc_snapshot.time + us / 1000000), (suseconds_t)(us % 1000000)};
+    if (!settimeofday(&tv, nullptr)) {
+      time = tv.tv_sec;
+      time_sync_time = rtc_snapshot.time_sync_time;
+    }
+  }
+#endif // DS_CAP_SYS_TIME
+  return true;
+}
+
+// Store system state into RTC memory, to be recovered after a warm reset. Returns true on success
+//// Wi-Fi parameters are only refreshed while connected, so that a snapshot taken during an outage still allows a fast reconnect
+bool System::storeRTCSnapshot() {
+  rtc_snapshot.magic = RTC_SNAPSHOT_MAGIC;
+#ifdef DS_CAP_SYS_TIME
+  if (time_sync_time) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    rtc_snapshot.rtc_time = system_get_rtc_time();
+    rtc_snapshot.rtc_cali = system_rtc_clock_cali_proc();
+    rtc_snapshot.time = tv.tv_sec;
+    rtc_snapshot.time_us = tv.tv_usec;
+    rtc_snapshot.time_sync_time = time_sync_time;
+  }
+#endif // DS_CAP_SYS_TIME
+#ifdef DS_CAP_SYS_NETWORK
+  if (networkIsConnected()) {
+    rtc_snapshot.channel = WiFi.channel();
+    memcpy(rtc_snapshot.bssid, WiFi.BSSID(), sizeof(rtc_snapshot.bssid));
+  }
+#endif // DS_CAP_SYS_NETWORK
+  rtc_snapshot.crc = crc32(&rtc_snapshot, offsetof(RTCSnapshot, crc));
+  if (!setRTCMem(reinterpret_cast<const uint32_t *>(&rtc_snapshot), DS_RTCMEM_SLOT_SYS, DS_RTCMEM_SLOTS_SYS)) {
+    log->printf(TIMED("Unable to store system state in RTC memory\n"));
+    return false;
+  }
+  return true;
 }
 #endif // DS_CAP_SYS_RTCMEM
 
@@ -177,11 +270,18 @@ static const char *DS_TIMEZONE_STRING PROGMEM = __XSTRING(DS_TIMEZONE);  // Impo
 #include <sntp.h>            // SNTP_UPDATE_DELAY
 #endif // DS_CAP_SYS_NETWORK
 
+// Source of the current time. Can be overridden with a simulated clock
+#ifndef DS_TIME_SOURCE
+#define DS_TIME_SOURCE() ::time(nullptr)
+#endif // !DS_TIME_SOURCE
+
 time_sync_t System::time_sync_status = TIME_SYNC_NONE;
 time_t System::time_sync_time = 0;
 time_t System::time = 0;
 struct tm System::tm_time;   // Initialized in begin()
 uint8_t System::time_change_flags = TIME_CHANGE_NONE;
+unsigned long System::time_millis = 0;
+time_t System::calendar_end = 0;
 
 void (*System::onTimeSync)() __attribute__ ((weak)) = nullptr;
 
@@ -189,8 +289,8 @@ void (*System::onTimeSync)() __attribute__ ((weak)) = nullptr;
 void System::timeSyncHandler() {
 
   // Update cached values
-  ::time(&time);
-  localtime_r(&time, &tm_time);
+  time = DS_TIME_SOURCE();
+  resetCalendar();
 
 #ifdef DS_CAP_SYS_LOG
   log->printf(TIMED("System clock %s: %s\n"), time_sync_time ? "updated" : "set", getTimeStr().c_str());
@@ -211,6 +311,9 @@ void System::timeSyncHandler() {
 #endif // DS_CAP_APP_LOG
   time_sync_time = time;
   time_sync_status = TIME_SYNC_OK;
+#ifdef DS_CAP_SYS_RTCMEM
+  storeRTCSnapshot();
+#endif // DS_CAP_SYS_RTCMEM
 
   // Call the user hook
   if (onTimeSync)
@@ -248,7 +351,7 @@ void System::setTime(const time_t new_time) {
   const struct timeval tv_new_time = {new_time, 0};
   if (!settimeofday(&tv_new_time, NULL)) {
     time = new_time;
-    localtime_r(&time, &tm_time);
+    resetCalendar();
     setTimeSyncTime(time);
     setTimeSyncStatus(TIME_SYNC_OK);
   }
@@ -266,6 +369,35 @@ String System::getTimeStr(const time_t t) {
   return time_str;
 }
 
+// Convert current time into tm_time and find the next DST change
+//// Until then, update() advances tm_time by one second arithmetically, which is much cheaper than localtime_r().
+//// DST changes never happen twice within a week, so the search is limited to a week ahead; it is repeated when that runs out
+void System::resetCalendar() {
+  static const time_t CALENDAR_HORIZON = 7 * 24 * 60 * 60;
+
+  localtime_r(&time, &tm_time);
+  struct tm tm_probe;
+  time_t from = time, to = time + CALENDAR_HORIZON;
+  localtime_r(&to, &tm_probe);
+  if (tm_probe.tm_isdst != tm_time.tm_isdst)
+    while (to - from > 1) {                   // Binary search: DST flag is the same as now at 'from' and different at 'to'
+      const auto mid = from + (to - from) / 2;
+      localtime_r(&mid, &tm_probe);
+      if (tm_probe.tm_isdst == tm_time.tm_isdst)
+        from = mid;
+      else
+        to = mid;
+    }
+  calendar_end = to;
+}
+
+// Return number of days in a month (tm_mon, tm_year conventions)
+static uint8_t daysInMonth(const int mon, const int year) {
+  static const uint8_t DAYS[] PROGMEM = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  const auto y = year + 1900;
+  return pgm_read_byte(&DAYS[mon]) + (mon == 1 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0));
+}
+
 // Return true if new second has arrived
 bool System::newSecond() {
   return time_change_flags & TIME_CHANGE_SECOND;
@@ -370,10 +502,7 @@ String System::getBootTimeStr() {
 #endif // DS_FS_TYPE == SPIFFS
 
 fs::FS& System::fs = DS_FS_TYPE;
-
-#ifdef DS_CAP_WEB_TIMERS
-static const char *DS_SYS_FOLDER_NAME PROGMEM = "/ds"; // Folder where settings are stored
-#endif // DS_CAP_WEB_TIMERS
+const char *System::sys_folder_name PROGMEM = "/ds";  // Folder where settings are stored
 
 #endif // DS_CAP_SYS_FS
 
@@ -389,6 +518,23 @@ static const char *DS_SYS_FOLDER_NAME PROGMEM = "/ds"; // Folder where settings
 
 const char *System::hostname PROGMEM __attribute__ ((weak)) = "espDS";
 static const unsigned long NETWORK_CONNECT_TIMEOUT = 20000; // (ms)
+#ifdef DS_CAP_SYS_RTCMEM
+static const unsigned long NETWORK_FAST_CONNECT_TIMEOUT = 3000; // (ms)
+
+// Start connecting to the configured network, optionally to a given access point on a given channel (which skips the scan).
+//// Credentials are not changing, so they are not rewritten into flash
+static void beginNetwork(const int32_t channel = 0, const uint8_t *bssid = nullptr) {
+  WiFi.persistent(false);
+  WiFi.begin(
+#ifdef DS_CAP_WIFIMANAGER
+    WiFi.SSID(), WiFi.psk(),
+#else
+    System::wifi_ssid, System::wifi_pass,
+#endif // DS_CAP_WIFIMANAGER
+    channel, bssid);
+  WiFi.persistent(true);
+}
+#endif // DS_CAP_SYS_RTCMEM
 
 #ifdef DS_CAP_SYS_TIME
 #include <sntp.h>            // SNTP server
@@ -421,6 +567,13 @@ void System::connectNetwork(
 
     WiFi.mode(WIFI_STA);
     WiFi.hostname(hostname);
+#ifdef DS_CAP_SYS_RTCMEM
+    // After a warm reset, join the access point last used directly, skipping the scan. Fall back to a normal connection if this does not work quickly
+    auto fast_connect = warm_start && rtc_snapshot.channel;
+    if (fast_connect)
+      beginNetwork(rtc_snapshot.channel, rtc_snapshot.bssid);
+    else
+#endif // DS_CAP_SYS_RTCMEM
     WiFi.begin(
 #ifndef DS_CAP_WIFIMANAGER
       wifi_ssid, wifi_pass
@@ -434,6 +587,12 @@ void System::connectNetwork(
 
     auto t0 = millis();
     while (!networkIsConnected() && millis() - t0 < NETWORK_CONNECT_TIMEOUT) {
+#ifdef DS_CAP_SYS_RTCMEM
+      if (fast_connect && millis() - t0 >= NETWORK_FAST_CONNECT_TIMEOUT) {
+        fast_connect = false;
+        beginNetwork();
+      }
+#endif // DS_CAP_SYS_RTCMEM
 #ifdef DS_CAP_SYS_LED
       if (led)
         led->Update();
@@ -458,6 +617,10 @@ void System::connectNetwork(
     else
       log->println(F("connection timeout"));
 #endif // DS_CAP_SYS_LOG
+#ifdef DS_CAP_SYS_RTCMEM
+    if (networkIsConnected())
+      storeRTCSnapshot();
+#endif // DS_CAP_SYS_RTCMEM
 
 #ifdef DS_CAP_WIFIMANAGER
   }
@@ -611,10 +774,6 @@ static const char *FAV_ICON_PATH PROGMEM = "/favicon.png"; // Favicon on disk
 #endif // DS_CAP_SYS_FS
 static const size_t MAX_WEB_PAGE_SIZE = 2048;    // Preallocated web page buffer size (B)
 
-#ifdef DS_CAP_WEB_TIMERS
-std::forward_list<String> System::timer_actions; // List of timer actions
-#endif // DS_CAP_WEB_TIMERS
-
 // Add standard header to the web page
 void System::pushHTMLHeader(const String& title, const String& head_user, bool redirect) {
   web_page = F(
@@ -834,6 +993,12 @@ void System::serveAbout() {
   web_page += TR_END;
 #endif // DS_CAP_SYS_TIME
 
+#ifdef DS_CAP_TIMERS
+  web_page += TR_BEGIN("Timer Lateness");
+  web_page += getTimerStats();
+  web_page += TR_END;
+#endif // DS_CAP_TIMERS
+
 #ifdef DS_CAP_SYS_UPTIME
   web_page += TR_BEGIN("System Uptime");
   web_page += getUptimeStr();
@@ -1009,12 +1174,277 @@ void System::sendWebPage() {
  *************************************************************************/
 #ifdef DS_CAP_WEB_TIMERS
 
+#include <map>                       // Form field index
+
 #ifdef DS_CAP_SYS_FS
 static const char   *TIMERS_CFG_NAME PROGMEM = "timers.cfg"; // Configuration file name
-static const uint8_t TIMERS_CFG_VERSION      = 1;            // File format version. Increment on incompatible changes
+static const uint8_t TIMERS_CFG_VERSION      = 2;            // File format version. Increment on incompatible changes
+static const uint8_t TIMERS_CFG_VERSION_V1   = 1;            // The first version of the format stored the web page script
+static const uint32_t TIMERS_CFG_MAGIC       = 0x52544d44;   // "DMTR" marker at the file start
 String System::timers_cfg_name;                              // Full path to the timers configuration file
 #endif // DS_CAP_SYS_FS
 
+// Timer configuration file header
+struct TimersHeader {
+  uint32_t magic;                          // TIMERS_CFG_MAGIC
+  uint8_t version;                         // TIMERS_CFG_VERSION
+  uint8_t active;                          // 1 if timers are active
+  uint16_t count;                          // Number of timer records following the header
+  uint32_t crc;                            // CRC-32 of the fields above
+};
+
+// Timer configuration record. Records are of fixed size, so they can be read one by one into the stack.
+// Timer with identifier N is stored in the record N - 1. Records of removed timers are marked with TIMER_INVALID type
+struct TimerRecord {
+  uint8_t type;                            // Timer type (timer_type_t)
+  uint8_t armed;                           // 1 if timer is armed
+  uint8_t dow;                             // Day of week bitmask
+  uint8_t skip_missed;                     // 1 if missed firings are skipped rather than run late (was reserved and zero)
+  int32_t time;                            // Absolute timer: seconds from midnight; solar timer: offset (min); countdown timer: interval (s)
+  int32_t offset;                          // Countdown timer: offset from midnight (s)
+  char action[TIMER_ACTION_NAME_MAX + 1];  // Action name (zero-terminated)
+  uint32_t crc;                            // CRC-32 of the fields above
+};
+
+// Create timer from configuration record. Returns timer of TIMER_INVALID type if record is invalid
+static Timer timerFromRecord(const TimerRecord& record, const int id) {
+  if (crc32(&record, offsetof(TimerRecord, crc)) != record.crc || record.action[sizeof(record.action) - 1])
+    return Timer();
+  Timer timer;
+  switch (record.type) {
+    case TIMER_ABSOLUTE:
+      timer = TimerAbsolute(record.action, record.time / 3600, record.time / 60 % 60, record.time % 60, record.dow, record.armed, true, false, id);
+      break;
+    case TIMER_SUNRISE:
+    case TIMER_SUNSET:
+      timer = TimerSolar(record.action, (timer_type_t)record.type, record.time, record.dow, record.armed, true, false, id);
+      break;
+    case TIMER_COUNTDOWN_ABS:
+      timer = TimerCountdownAbs(record.action, record.time, record.offset, record.dow, record.armed, true, false, id);
+      break;
+    default:
+      return Timer();
+  }
+  if (record.skip_missed)
+    timer.skipMissed();
+  return timer;
+}
+
+// Fill in configuration record from timer
+static void timerToRecord(const Timer& timer, TimerRecord& record) {
+  memset(&record, 0, sizeof(record));
+  record.type = timer.getType();
+  record.armed = timer.isArmed();
+  record.dow = timer.getDayOfWeek();
+  record.skip_missed = timer.skipsMissed();
+  switch (timer.getType()) {
+    case TIMER_ABSOLUTE:
+      record.time = timer.getHour() * 3600 + timer.getMinute() * 60 + timer.getSecond();
+      break;
+    case TIMER_SUNRISE:
+    case TIMER_SUNSET:
+      record.time = timer.getOffset();
+      break;
+    case TIMER_COUNTDOWN_ABS:
+      record.time = timer.getInterval();
+      record.offset = timer.getOffset();
+      break;
+    default: ;  // Not happening
+  }
+  strncpy(record.action, timer.getAction().c_str(), sizeof(record.action) - 1);
+  record.crc = crc32(&record, offsetof(TimerRecord, crc));
+}
+
+#ifdef DS_CAP_SYS_FS
+// Return path to the timer configuration file of a given format version
+static String timersCfgName(const uint8_t version) {
+  String name(System::sys_folder_name);
+  name += F("/");
+  name += TIMERS_CFG_NAME;
+  name.replace(F("."), String(version) + F("."));
+  return name;
+}
+
+// Load timer configuration. Returns true on success
+//// The file is read sequentially, one fixed-size record at a time. Damaged records are skipped.
+//// If removed timers left free records, the file is compacted
+bool System::loadTimers() {
+  auto cfg_file = fs.open(timers_cfg_name, "r");
+  if (!cfg_file) {
+
+    // Migrate configuration from the text format, if any
+    const auto cfg_name_v1 = timersCfgName(TIMERS_CFG_VERSION_V1);
+    if (!fs.exists(cfg_name_v1) || !loadTimersV1(cfg_name_v1))
+      return false;
+    if (storeTimers())
+      fs.remove(cfg_name_v1);
+#ifdef DS_CAP_SYS_LOG
+    log->print(F("(migrated) "));
+#endif // DS_CAP_SYS_LOG
+    return true;
+  }
+
+  TimersHeader header;
+  auto ret = cfg_file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == TIMERS_CFG_MAGIC
+    && header.version == TIMERS_CFG_VERSION && crc32(&header, offsetof(TimersHeader, crc)) == header.crc;
+  if (ret) {
+    abs_timers_active = header.active;
+    TimerRecord record;
+    uint16_t n_timers = 0;
+    for (uint16_t i = 0; i < header.count && n_timers < DS_TIMERS_MAX && cfg_file.read((uint8_t *)&record, sizeof(record)) == sizeof(record); i++)
+      if (addTimer(timerFromRecord(record, i + 1)))
+        n_timers++;
+    cfg_file.close();
+    if (n_timers != header.count && n_timers < DS_TIMERS_MAX)  // Do not drop the records which did not fit into the table
+      storeTimers();
+  } else
+    cfg_file.close();
+  scheduleTimers();
+  return ret;
+}
+
+// Load timer configuration in the first (text) format. Returns true on success
+bool System::loadTimersV1(const String& cfg_name) {
+  auto cfg_file = fs.open(cfg_name, "r");
+  if (!cfg_file)
+    return false;
+
+  // Read global flag
+  String line = cfg_file.readStringUntil('\n');
+  abs_timers_active = line.toInt();
+
+  // Parse timer configuration. Format:
+  // |       |   action   | active | day of week |  type  |  hours  | mins | diff (optional) |
+  //      aT('lamp on'    ,      1 ,          127, 'at'   , 'sunset', 15   ,             '-' );
+  uint8_t tid = 0;
+  while (cfg_file.available()) {
+    line = cfg_file.readStringUntil('\n');
+    line.trim();
+    if (!line.startsWith(F("aT(")))
+      continue;
+
+    tid++;
+    line.remove(0, line.indexOf('\'') + 1);
+    const String action = line.substring(0, line.indexOf('\''));
+
+    line.remove(0, line.indexOf(',') + 1);
+    line.trim();
+    const bool active = line.toInt();
+
+    line.remove(0, line.indexOf(',') + 1);
+    line.trim();
+    const auto dow = (uint8_t)line.toInt();
+
+    line.remove(0, line.indexOf('\'') + 1);
+    const String at = line.substring(0, line.indexOf('\''));
+
+    line.remove(0, line.indexOf(',') + 1);
+    line.trim();
+    String solar_type;
+    uint16_t hour = 0;
+    if (line[0] == '\'') {
+      line.remove(0, 1);
+      solar_type = line.substring(0, line.indexOf('\''));
+    } else
+      hour = line.toInt();
+
+    line.remove(0, line.indexOf(',') + 1);
+    line.trim();
+    int16_t minute = line.toInt();
+
+    if (line.indexOf(',') != -1) {
+      line.remove(0, line.indexOf('\'') + 1);
+      if (line[0] == '-')
+        minute = -minute;
+    }
+
+    // Create timer
+    if (at == F("at")) {
+      if (solar_type.length())
+        addTimer(TimerSolar(action, solar_type == F("sunrise") ? TIMER_SUNRISE : TIMER_SUNSET, minute, dow, active, true, false, tid));
+      else
+        addTimer(TimerAbsolute(action, hour, minute, 0, dow, active, true, false, tid));
+    } else
+    if (at == F("every"))
+
+      // x60 because timer has seconds' resolution, but user specifies time in minutes
+      addTimer(TimerCountdownAbs(action, hour * 60, minute * 60, dow, active, true, false, tid));
+  }
+  cfg_file.close();
+  scheduleTimers();
+  return true;
+}
+
+// Store timer configuration. Returns true on success
+bool System::storeTimers() {
+  auto cfg_file = fs.open(timers_cfg_name, "w");
+  if (!cfg_file)
+    return false;
+
+  // Timers are renumbered in table order, so that identifiers match record numbers
+  TimersHeader header = {TIMERS_CFG_MAGIC, TIMERS_CFG_VERSION, abs_timers_active, 0, 0};
+  for (auto& timer : timers)
+    if (timer.getType() != TIMER_INVALID)
+      timer.setID(++header.count);
+  header.crc = crc32(&header, offsetof(TimersHeader, crc));
+  auto ret = cfg_file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  TimerRecord record;
+  for (const auto& timer : timers)
+    if (ret && timer.getType() != TIMER_INVALID) {
+      timerToRecord(timer, record);
+      ret = cfg_file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record);
+    }
+  cfg_file.close();
+  return ret;
+}
+
+// Store configuration record of a timer (0 = global settings only). Returns true on success
+//// Only the header and the affected record are written. Timer missing in the table gets its record freed
+bool System::storeTimer(const int id) {
+  auto cfg_file = fs.open(timers_cfg_name, "r+");
+  if (!cfg_file)
+    return storeTimers();
+  TimersHeader header;
+  if (cfg_file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) || header.magic != TIMERS_CFG_MAGIC
+    || header.version != TIMERS_CFG_VERSION || crc32(&header, offsetof(TimersHeader, crc)) != header.crc) {
+    cfg_file.close();
+    return storeTimers();
+  }
+
+  auto ret = true;
+  TimerRecord record;
+  if (id > 0) {
+    const auto timer = getTimerByID(id);
+    if (timer)
+      timerToRecord(*timer, record);
+    else {
+      memset(&record, 0, sizeof(record));
+      record.type = TIMER_INVALID;
+      record.crc = crc32(&record, offsetof(TimerRecord, crc));
+    }
+    const TimerRecord record_timer = record;
+
+    // Records between the end of file and the timer's one (if any) are written as free
+    record.type = TIMER_INVALID;
+    memset(record.action, 0, sizeof(record.action));
+    record.crc = crc32(&record, offsetof(TimerRecord, crc));
+    for (; ret && header.count < id - 1; header.count++)
+      ret = cfg_file.seek(sizeof(header) + header.count * sizeof(record))
+        && cfg_file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record);
+    if (header.count < id)
+      header.count = id;
+    ret = ret && cfg_file.seek(sizeof(header) + (id - 1) * sizeof(record))
+      && cfg_file.write((const uint8_t *)&record_timer, sizeof(record_timer)) == sizeof(record_timer);
+  }
+
+  header.active = abs_timers_active;
+  header.crc = crc32(&header, offsetof(TimersHeader, crc));
+  ret = ret && cfg_file.seek(0) && cfg_file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  cfg_file.close();
+  return ret;
+}
+#endif // DS_CAP_SYS_FS
+
 // Scripting for timers web page. Do not edit compressed code; edit the master copy in src-js/ and regenerate
 static const char *timers_script PROGMEM = "<script>"
   "var DW={Monday:2,Tuesday:4,Wednesday:8,Thursday:16,Friday:32,Saturday:64,Sunday:1},N=0;function pW(e,t=127){var n=docume"
@@ -1032,7 +1462,7 @@ static const char *timers_script PROGMEM = "<script>"
   "+\"==a?' selected=\"selected\"':\"\")+'>+</option><option value=\"-\"'+(\"-\"==a?' selected=\"selected\"':\"\")+\">&#x22"
   "12;</option></select>\":l.innerHTML=\"h&nbsp;\":(l.innerHTML=\"min offset from midnight by\",pT(\"m\"+e,parseInt(t),0,0,"
   "0,0,n))}function cA(e,t,n=0,a=0,l=\"+\"){\"at\"==t?(pT(\"h\"+e,24,1,1,0,1,n),pT(\"m\"+e,60,0,1,0,0,a)):pT(\"h\"+e,1441,0"
-  ",0,1,0,n=n||1),cS(e,n,a,l)}function aT(e,t=1,n=127,a=\"at\",l=0,d=0,i=\"+\"){var c=document.createElement(\"p\");c.id=\""
+  ",0,1,0,n=n||1),cS(e,n,a,l)}function aT(e,t=1,n=127,a=\"at\",l=0,d=0,i=\"+\",g=1){var c=document.createElement(\"p\");c.id=\""
   "timer\"+ ++N,c.style=\"background: WhiteSmoke;\",c.innerHTML='\\n&nbsp;&nbsp;&nbsp;<input name=\"active'+N+'\" type=\"ch"
   "eckbox\"'+(t?' checked=\"checked\"':\"\")+' style=\"vertical-align: middle;\" title=\"deactivate timer\"/>&nbsp;\\n<a st"
   "yle=\"text-decoration: none; color: black;\" href=\"javascript:dT('+N+')\" title=\"delete timer\">&#x2326;</a>&nbsp;&nbs"
@@ -1041,58 +1471,72 @@ static const char *timers_script PROGMEM = "<script>"
   "value=\"every\">&#x1f503; every</option></select>&nbsp;<select id=\"h'+N+'\" name=\"h'+N+'\" onchange=\"cS('+N+', this.v"
   "alue)\" style=\"text-align-last: right;\"></select>\\n<span id=\"sep'+N+'\">h&nbsp;</span>\\n<select id=\"m'+N+'\" name="
   "\"m'+N+'\" style=\"text-align-last: right;\"></select> min&nbsp;&nbsp;&nbsp;\\nexecute <select id=\"action'+N+'\" name=\""
-  "action'+N+'\"></select>\\n';var o=document.createTextNode(\"\\n\\n\");document.getElementById(\"timers\").appendChild(o)"
+  "action'+N+'\"></select>&nbsp;&nbsp;&nbsp;\\n<input name=\"late'+N+'\" type=\"checkbox\"'+(g?' checked=\"checked\"':\"\")+' style=\"vertical-"
+  "align: middle;\" title=\"run the action late if the firing was missed\"/>&nbsp;if missed, run late\\n';var o=document.createTextNode(\"\\n\\n\");document.getElementById(\"timers\").appendChild(o)"
   ",document.getElementById(\"timers\").appendChild(c),pW(\"dow\"+N,n),pA(\"action\"+N,e),document.getElementById(\"at\"+N)"
   ".value=a,cA(N,a,l,d,i)}function dT(e){document.getElementById(\"timers\").removeChild(document.getElementById(\"timer\"+"
   "e))}"
   "</script>\n";
 
 // Generate timer configuration as JavaScript code
+//// Table order is not ID order (freed entries are refilled first), so new timers are numbered after the highest ID, not after the last timer listed
 void System::timersJS(String& str) {
-  for (auto timer : timers) {
-    if (!timer) continue;
-    auto timer_type = timer->getType();
-    str += F("    aT('");
-    str += timer->getAction();
+  int id_max = 0;
+  for (const auto& timer : timers) {
+    const auto timer_type = timer.getType();
+    if (timer_type == TIMER_INVALID)
+      continue;
+    if (timer.getID() > id_max)
+      id_max = timer.getID();
+    str += F("    N = ");             // Keep timer identifiers across page reloads
+    str += timer.getID() - 1;
+    str += F("; aT('");
+    str += timer.getAction();
     str += F("', ");
-    str += timer->isArmed();
+    str += timer.isArmed();
     str += F(", ");
-    str += timer->getDayOfWeek();
+    str += timer.getDayOfWeek();
     str += F(", ");
     str += timer_type == TIMER_COUNTDOWN_ABS ? F("'every'") : F("'at'");
     str += F(", ");
     switch (timer_type) {
-      case TIMER_ABSOLUTE     : str += timer->getHour();                                                            break;
-      case TIMER_SUNRISE      : str += F("'sunrise'");                                                              break;
-      case TIMER_SUNSET       : str += F("'sunset'" );                                                              break;
-      case TIMER_COUNTDOWN_ABS: str += (unsigned int)(static_cast<TimerCountdownAbs *>(timer)->getInterval() / 60); break;
+      case TIMER_ABSOLUTE     : str += timer.getHour();                      break;
+      case TIMER_SUNRISE      : str += F("'sunrise'");                       break;
+      case TIMER_SUNSET       : str += F("'sunset'" );                       break;
+      case TIMER_COUNTDOWN_ABS: str += (unsigned int)timer.getInterval() / 60; break;
       default                 : ; // Normally never happens
     }
     str += F(", ");
     switch (timer_type) {
-      case TIMER_ABSOLUTE     : str += timer->getMinute();                                                          break;
-      case TIMER_SUNRISE      : str += abs(static_cast<TimerSolar *>(timer)->getOffset());                          break;
-      case TIMER_SUNSET       : str += abs(static_cast<TimerSolar *>(timer)->getOffset());                          break;
-      case TIMER_COUNTDOWN_ABS: str += static_cast<TimerCountdownAbs *>(timer)->getOffset() / 60;                   break;
+      case TIMER_ABSOLUTE     : str += timer.getMinute();                    break;
+      case TIMER_SUNRISE      :
+      case TIMER_SUNSET       : str += abs(timer.getOffset());               break;
+      case TIMER_COUNTDOWN_ABS: str += timer.getOffset() / 60;               break;
       default                 : ; // Normally never happens
     }
-    if (timer_type == TIMER_SUNRISE || timer_type == TIMER_SUNSET) {
-      str += F(", ");
-      str += static_cast<TimerSolar *>(timer)->getOffset() < 0 ? F("'-'") : F("'+'");
-    }
+    str += F(", ");
+    str += timer.getOffset() < 0 && (timer_type == TIMER_SUNRISE || timer_type == TIMER_SUNSET) ? F("'-'") : F("'+'");
+    str += F(", ");
+    str += !timer.skipsMissed();
     str += F(");\n");
   }
+  str += F("    N = ");
+  str += id_max;
+  str += F(";\n");
 }
 
 // Serve the "timers" page
 void System::serveTimers() {
   String header(timers_script);
   header += F("<script>\n  var A = [");
-  for (auto action : timer_actions) {
-    header += F("'");
-    header += action;
-    header += F("', ");                 // JS is tolerant to a trailing comma
-  }
+  auto n_actions = 0;
+  for (const auto& action : timer_actions)
+    if (action.offered) {
+      header += F("'");
+      header += action.name;
+      header += F("', ");               // JS is tolerant to a trailing comma
+      n_actions++;
+    }
   header += F("];\n  function addTimes() {\n");
   timersJS(header);
   header += F("  }\n");
@@ -1107,7 +1551,7 @@ void System::serveTimers() {
     "<h3>Timer Configuration</h3>\n"
     "[ <a href=\"/\">home</a> ]<hr/>\n"
   );
-  if (timer_actions.empty())
+  if (!n_actions)
     web_page += F("<p>No timer actions available to configure.</p>");
   else {
     web_page += F(
@@ -1127,185 +1571,170 @@ void System::serveTimers() {
       "</form>\n"
     );
   }
+  web_page += F("<p>Timer lateness: ");
+  web_page += getTimerStats();
+  web_page += F("</p>\n");
 
   pushHTMLFooter();
   sendWebPage();
 }
 
 // Serve the "timers save" page
+//// Form fields are collected per timer in a single pass; then only the timers which differ from the current ones are replaced
 void System::serveTimersSave() {
 
-  // Clear the current list. Updating existing timers is too painful, as user can change timer types
-  for (auto timer : timers) {
-    if (!timer) continue;
-    switch (timer->getType()) {
-      case TIMER_ABSOLUTE:      delete timer;                                   break;
-      case TIMER_SUNRISE :
-      case TIMER_SUNSET  :      delete static_cast<TimerSolar *>(timer);        break;
-      case TIMER_COUNTDOWN_ABS: delete static_cast<TimerCountdownAbs *>(timer); break;
-      default: ;  // Not happening
-    }
-  }
-  timers.clear();
-  abs_timers_active = false;
-
-  // First, create all the timers
-  //// Create timers inactive by default, to match HTTP POST behavior, which will send checkboxes of active timers only
-  //// Similarly, day of week is set to 'none'; active days are passed via POST
+  // Timer fields from the form
+  struct TimerArgs {
+    String at;                             // "at" or "every"
+    String h;                              // Hour, solar event or countdown interval (min)
+    int16_t m;                             // Minute, solar offset or countdown offset (min)
+    bool minus;                            // True if solar offset is negative
+    uint8_t dow;                           // Day of week bitmask
+    bool active;                           // True if timer is armed
+    bool late;                             // True if missed firings are run late
+    String action;                         // Timer action
+  };
+  std::map<int, TimerArgs> form;           // Timer fields indexed by timer ID
+
+  // New timers are numbered after the highest ID in use, and there can be no more of them than the table holds. IDs beyond are rejected,
+  // as they would make the configuration file grow by a free record per skipped ID
+  auto id_limit = DS_TIMERS_MAX;
+  for (const auto& timer : timers)
+    if (timer.getType() != TIMER_INVALID && timer.getID() + DS_TIMERS_MAX > id_limit)
+      id_limit = timer.getID() + DS_TIMERS_MAX;
+
+  // Index the arguments. Unchecked checkboxes and unselected days of week are not sent, so they default to off
+  auto timers_active = false;
   for (unsigned int i = 0; i < (unsigned int)web_server.args(); i++) {
     const String arg_name = web_server.argName(i);
-    if (arg_name.startsWith(F("at"))) {
-      const auto id = arg_name.substring(2).toInt();
-      if (id) {
-        if (web_server.arg(i) == F("at")) {
-
-          // Need to further look at "hour" field to decide on timer type
-          String h_field = F("h");
-          h_field += id;
-          for (unsigned int j = 0; j < (unsigned int)web_server.args(); j++) {
-            if (web_server.argName(j) == h_field) {
-              if (web_server.arg(j) == F("sunrise") || web_server.arg(j) == F("sunset")) {
-
-                // New solar timer
-                auto timer = new TimerSolar(F("undefined"), web_server.arg(j) == F("sunrise") ? TIMER_SUNRISE : TIMER_SUNSET,
-                  0, TIMER_DOW_NONE /* ! */, false /* ! */, true, false, id);
-                timers.push_front(timer);
-              } else {  // Invalid hour string values are accepted and treated as hour == 0
-
-                // New absolute timer
-                auto timer = new TimerAbsolute(F("undefined"), 0, 0, 0, TIMER_DOW_NONE /* ! */, false /* ! */, true, false, id);
-                timers.push_front(timer);
-              }
-            }
-          }
-        } else {
-          if (web_server.arg(i) == F("every")) {
+    if (arg_name == F("active")) {
+      timers_active = true;
+      continue;
+    }
 
-            // New periodic timer
-            auto timer = new TimerCountdownAbs(F("undefined"), 60, 0, TIMER_DOW_NONE /* ! */, false /* ! */, true, false, id);
-            timers.push_front(timer);
-          }
-        }
+    static const char *const FIELDS[] = {"active", "action", "at", "dow", "h", "m", "sign", "late"};  // "active" before "action" and "at"
+    uint8_t field = 0;
+    while (field < sizeof(FIELDS) / sizeof(FIELDS[0]) && !arg_name.startsWith(FIELDS[field]))
+      field++;
+    if (field == sizeof(FIELDS) / sizeof(FIELDS[0]))
+      continue;
+    const auto id = arg_name.substring(strlen(FIELDS[field])).toInt();
+    if (id <= 0 || id > id_limit)
+      continue;
+    auto& timer_args = form[id];           // Value-initialized on first use: inactive, no days of week
+    const auto& arg = web_server.arg(i);
+    switch (field) {
+      case 0: timer_args.active = true;                      break;
+      case 1: timer_args.action = arg;                       break;
+      case 2: timer_args.at = arg;                           break;
+      case 3: {
+        const auto dow_web = arg.toInt();
+        timer_args.dow = dow_web >= TIMER_DOW_NONE && dow_web < TIMER_DOW_INVALID ? timer_args.dow | dow_web : TIMER_DOW_INVALID;
+        break;
       }
+      case 4: timer_args.h = arg;                            break;
+      case 5: timer_args.m = arg.toInt();                    break;
+      case 6: timer_args.minus = arg == F("-");              break;
+      case 7: timer_args.late = true;                        break;
     }
   }
-  timers.reverse();   // Needed to make the list appear in user-defined order
-
-  // Now set timer properties
-  for (unsigned int i = 0; i < (unsigned int)web_server.args(); i++) {
-    const String arg_name = web_server.argName(i);
-
-    if (arg_name == F("active"))
-      abs_timers_active = true;
-    else
-
-    if (arg_name.startsWith(F("active"))) {
-      const auto id = arg_name.substring(6).toInt();
-      auto timer = getTimerAbsByID(id);   // Safe if ID is 0 or not a number
-      if (timer)
-        timer->arm();
-    } else
-
-    if (arg_name.startsWith(F("dow"))) {
-      const auto id = arg_name.substring(3).toInt();
-      auto dow_web = web_server.arg(i).toInt();
-      if (dow_web < TIMER_DOW_NONE || dow_web > TIMER_DOW_INVALID)
-        dow_web = TIMER_DOW_INVALID;
-      auto timer = getTimerAbsByID(id);
-      if (timer) {
-        if (dow_web == TIMER_DOW_INVALID)
-          timer->setDayOfWeek(TIMER_DOW_INVALID);
-        else
-          timer->enableDayOfWeek(dow_web);  // Use "enable" instead of "set", because HTTP will send bits separately
-      }
-    } else
-
-    if (arg_name.startsWith(F("h"))) {
-      const auto id = arg_name.substring(1).toInt();
-      auto timer = getTimerAbsByID(id);
-      if (timer) {
-        const auto timer_type = timer->getType();
-        const auto arg_i = web_server.arg(i).toInt();
-        if (timer_type == TIMER_ABSOLUTE) {
-          timer->setHour(arg_i);     // Safe if bogus hour
-        } else
-        if (timer_type == TIMER_COUNTDOWN_ABS) {
-          static_cast<TimerCountdownAbs *>(timer)->setInterval(arg_i * 60); // Safe if bogus parameter
-        }
-        // For solar timers, "h" is already handled at timer creation above
-      }
-    } else
 
-    if (arg_name.startsWith(F("m"))) {
-      const auto id = arg_name.substring(1).toInt();
-      auto timer = getTimerAbsByID(id);
-      if (timer) {
-        const auto timer_type = timer->getType();
-        auto arg_i = web_server.arg(i).toInt();
-        if (timer_type == TIMER_ABSOLUTE) {
-          timer->setMinute(arg_i);     // Safe if bogus minute
-        } else
-        if (timer_type == TIMER_SUNRISE || timer_type == TIMER_SUNSET) {
+#ifdef DS_CAP_SYS_FS
+  auto cfg_file_ok = true;
+#endif // DS_CAP_SYS_FS
 
-          // In this case, minute is interpreted as offset, and its sign is passed separately
-          String sign_field = F("sign");
-          sign_field += id;
-          for (unsigned int j = 0; j < (unsigned int)web_server.args(); j++)
-            if (web_server.argName(j) == sign_field && web_server.arg(j) == F("-"))
-              arg_i = -arg_i;
+  // Remove timers not present in the form. Removal only frees the table entry, so it is safe while iterating
+  for (const auto& timer : timers)
+    if (timer.getType() != TIMER_INVALID && form.find(timer.getID()) == form.end()) {
+      const auto id = timer.getID();
+      removeTimer(id);
+#ifdef DS_CAP_SYS_FS
+      cfg_file_ok = storeTimer(id) && cfg_file_ok;
+#endif // DS_CAP_SYS_FS
+    }
 
-          static_cast<TimerSolar *>(timer)->setOffset(arg_i); // Safe if bogus parameter
-        } else
-        if (timer_type == TIMER_COUNTDOWN_ABS)
-          static_cast<TimerCountdownAbs *>(timer)->setOffset(arg_i * 60); // Safe if bogus parameter
-      }
+  // Add new and replace changed timers. Invalid hour string values are accepted and treated as hour == 0
+  auto table_full = false;
+  auto actions_full = false;
+  auto action_long = false;
+  for (const auto& entry : form) {
+    const auto id = entry.first;
+    const auto& timer_args = entry.second;
+    Timer timer;
+    if (timer_args.at == F("at")) {
+      if (timer_args.h == F("sunrise") || timer_args.h == F("sunset"))
+        timer = TimerSolar(timer_args.action, timer_args.h == F("sunrise") ? TIMER_SUNRISE : TIMER_SUNSET,
+          timer_args.minus ? -timer_args.m : timer_args.m, timer_args.dow, timer_args.active, true, false, id);
+      else
+        timer = TimerAbsolute(timer_args.action, timer_args.h.toInt(), timer_args.m, 0, timer_args.dow, timer_args.active, true, false, id);
     } else
-
-    if (arg_name.startsWith(F("action"))) {
-      const auto id = arg_name.substring(6).toInt();
-      auto timer = getTimerAbsByID(id);
-      if (timer)
-        timer->setAction(web_server.arg(i));
+    if (timer_args.at == F("every"))
+      timer = TimerCountdownAbs(timer_args.action, timer_args.h.toInt() * 60, timer_args.m * 60, timer_args.dow, timer_args.active, true, false, id);
+    if (timer.getType() == TIMER_INVALID)
+      continue;
+    if (timer_args.action.length() > TIMER_ACTION_NAME_MAX) {
+      action_long = true;                  // It could not be stored in full
+      continue;
     }
+    if (timer.getActionID() == TIMER_ACTION_UNDEFINED && timer.getAction() != timer_args.action) {
+      actions_full = true;                 // Keep the old timer rather than lose its action
+      continue;
+    }
+    if (!timer_args.late)
+      timer.skipMissed();
+
+    TimerRecord record_new, record_old;
+    timerToRecord(timer, record_new);
+    const auto timer_old = getTimerByID(id);
+    if (timer_old)
+      timerToRecord(*timer_old, record_old);
+    if (timer_old && !memcmp(&record_new, &record_old, sizeof(record_new)))
+      continue;
+    if (!addTimer(timer)) {
+      table_full = true;
+      continue;
+    }
+#ifdef DS_CAP_SYS_FS
+    cfg_file_ok = storeTimer(id) && cfg_file_ok;
+#endif // DS_CAP_SYS_FS
   }
 
+  abs_timers_active = timers_active;
 #ifdef DS_CAP_SYS_FS
-
-  // Save timer configuration on disk
-  auto cfg_file = fs.open(timers_cfg_name, "w");
-  bool cfg_file_ok = cfg_file;
-  if (cfg_file_ok) {
-
-    // First write the global flags...
-    cfg_file_ok = cfg_file.println(abs_timers_active);
-
-    if (cfg_file_ok) {
-      // ... and then the timers' configuration (reuse the format used for web page)
-      String cfg;
-      timersJS(cfg);
-      if (cfg.length())
-        cfg_file_ok = cfg_file.print(cfg);
-    }
-    cfg_file.close();
-  }
+  cfg_file_ok = storeTimer(0) && cfg_file_ok;
 #endif // DS_CAP_SYS_FS
 
   // Report result
   String result;
   if (abs_timers_active) {
-    const auto n_timers = std::distance(timers.begin(), timers.end());
+    const auto n_timers = getTimerCount();
     result += n_timers;
     result += F(" timer");
     result += n_timers % 10 == 1 && n_timers != 11 ? F("") : F("s");
     result += F(" configured, ");
     unsigned int active = 0;
-    for (auto timer : timers)
-      if (timer && timer->isArmed())
+    for (const auto& timer : timers)
+      if (timer.getType() != TIMER_INVALID && timer.isArmed())
         active++;
     result += active;
     result += F(" active");
   } else
     result += F("Timers disabled");
+  if (table_full) {
+    result += F("; some timers dropped (maximum is ");
+    result += DS_TIMERS_MAX;
+    result += F(")");
+  }
+  if (actions_full) {
+    result += F("; some timers not saved (too many different actions; maximum is ");
+    result += TIMER_ACTION_MAX;
+    result += F(")");
+  }
+  if (action_long) {
+    result += F("; some timers not saved (action name too long; maximum is ");
+    result += TIMER_ACTION_NAME_MAX;
+    result += F(" characters)");
+  }
 #ifdef DS_CAP_SYS_LOG
   log->printf(TIMED(""));
   log->println(result);
@@ -1381,101 +1810,272 @@ void System::buttonEventHandler(AceButton* button, uint8_t event_type, uint8_t b
  *************************************************************************/
 #ifdef DS_CAP_TIMERS
 
-// Timer constructor
-Timer::Timer(const timer_type_t _type, const String _action,
-  const bool _armed, const bool _recurrent, const bool _transient, const int _id) :
-  id(_id >= -1 ? _id : -1), type(_type >= 0 && _type <= TIMER_INVALID ? _type : TIMER_INVALID),
-  action(_action), armed(_armed), recurrent(_recurrent), transient(_transient) {}
+static_assert(sizeof(Timer) == 16, "Timer is expected to be a packed 16-byte record");
 
-// Define pure virtual destructor (required by C++)
-Timer::~Timer() {
-}
+// Constructor of a free timer table entry
+//// Timer table is static, so this must not touch the action table, which might be not constructed yet
+Timer::Timer() :
+  id(-1), type(TIMER_INVALID), action(TIMER_ACTION_UNDEFINED), flags(0), dow(0), reserved(0), time(0), offset(0) {}
+
+// Timer constructor
+Timer::Timer(const timer_type_t _type, const String& _action,
+  const bool armed, const bool recurrent, const bool transient, const int _id) :
+  id(_id >= -1 && _id <= INT16_MAX ? _id : -1), type(_type >= 0 && _type <= TIMER_INVALID ? _type : TIMER_INVALID),
+  action(System::getTimerActionID(_action)),
+  flags((armed ? TIMER_FLAG_ARMED : 0) | (recurrent ? TIMER_FLAG_RECURRENT : 0) | (transient ? TIMER_FLAG_TRANSIENT : 0)),
+  dow(0), reserved(0), time(0), offset(0) {}
 
 // Return timer identifier
-inline int Timer::getID() const {
+int Timer::getID() const {
   return id;
 }
 
 // Set timer identifier
 void Timer::setID(const int new_id) {
-  if (new_id >= -1)
+  if (new_id >= -1 && new_id <= INT16_MAX)
     id = new_id;
 }
 
 // Get timer type
-inline timer_type_t Timer::getType() const {
-  return type;
+timer_type_t Timer::getType() const {
+  return (timer_type_t)type;
 }
 
-// Set timer type
+// Set timer type. Setting TIMER_INVALID frees the timer table entry
 void Timer::setType(const timer_type_t _type) {
   type = _type >= 0 && _type <= TIMER_INVALID ? _type : TIMER_INVALID;
 }
 
 // Return timer action
-inline const String& Timer::getAction() const {
-  return action;
+const String& Timer::getAction() const {
+  return System::getTimerAction(action).name;
 }
 
 // Set timer action
-inline void Timer::setAction(const String& new_action) {
+void Timer::setAction(const String& new_action) {
+  action = System::getTimerActionID(new_action);
+}
+
+// Return timer action identifier
+timer_action_t Timer::getActionID() const {
+  return action;
+}
+
+// Set timer action identifier
+void Timer::setActionID(const timer_action_t new_action) {
   action = new_action;
 }
 
+// Set or clear timer flag
+void Timer::setFlag(const uint8_t flag, const bool value) {
+  flags = value ? flags | flag : flags & ~flag;
+}
+
 // Return true if timer is armed
-inline bool Timer::isArmed() const {
-  return armed;
+bool Timer::isArmed() const {
+  return flags & TIMER_FLAG_ARMED;
 }
 
 // Arm the timer (default)
-inline void Timer::arm() {
-  armed = true;
+//// Arming a millisecond countdown timer starts counting its interval from now
+void Timer::arm() {
+  setFlag(TIMER_FLAG_ARMED, true);
+#ifdef DS_CAP_TIMERS_COUNT_MS
+  if (type == TIMER_COUNTDOWN_MS)
+    setDeadline(millis() + time);
+#endif // DS_CAP_TIMERS_COUNT_MS
 }
 
 // Disarm the timer
-inline void Timer::disarm() {
-  armed = false;
+void Timer::disarm() {
+  setFlag(TIMER_FLAG_ARMED, false);
 }
 
 // Return true if timer is recurrent
-inline bool Timer::isRecurrent() const {
-  return recurrent;
+bool Timer::isRecurrent() const {
+  return flags & TIMER_FLAG_RECURRENT;
 }
 
 // Make timer repetitive (default)
-inline void Timer::repeatForever() {
-  recurrent = true;
+void Timer::repeatForever() {
+  setFlag(TIMER_FLAG_RECURRENT, true);
 }
 
 // Make timer a one-time shot
-inline void Timer::repeatOnce() {
-  recurrent = false;
+void Timer::repeatOnce() {
+  setFlag(TIMER_FLAG_RECURRENT, false);
 }
 
 // Return true if timer is transient (i.e., will be dead after firing)
-inline bool Timer::isTransient() const {
-  return transient;
+bool Timer::isTransient() const {
+  return flags & TIMER_FLAG_TRANSIENT;
 }
 
 // Keep the timer around (default)
-inline void Timer::keep() {
-  transient = false;
+void Timer::keep() {
+  setFlag(TIMER_FLAG_TRANSIENT, false);
 }
 
 // Mark the timer for disposal
-inline void Timer::forget() {
-  transient = true;
+void Timer::forget() {
+  setFlag(TIMER_FLAG_TRANSIENT, true);
+}
+
+// Return true if missed firings are skipped rather than run late
+bool Timer::skipsMissed() const {
+  return flags & TIMER_FLAG_SKIP_MISSED;
+}
+
+// Run missed firings late (default)
+void Timer::runMissed() {
+  setFlag(TIMER_FLAG_SKIP_MISSED, false);
+}
+
+// Skip missed firings
+void Timer::skipMissed() {
+  setFlag(TIMER_FLAG_SKIP_MISSED, true);
 }
 
-// Abstract timer comparison operator
+// Timer comparison operator. Flags and derived settings (today's solar event time, countdown deadline) are not compared
 bool Timer::operator==(const Timer& timer) const {
-  return type == timer.getType() && id == timer.getID() && action == timer.getAction();
+  return type == timer.type && id == timer.id && action == timer.action && dow == timer.dow
+    && (type == TIMER_SUNRISE || type == TIMER_SUNSET || time == timer.time) && (type == TIMER_COUNTDOWN_MS || offset == timer.offset);
 }
 
-// Abstract timer comparison operator
+// Timer comparison operator
 bool Timer::operator!=(const Timer& timer) const {
   return !(*this == timer);
 }
+
+// Timer actions are interned: each name is stored once in the table, and timers refer to it by index.
+// Entries are not removed, so that identifiers held by timers stay valid; withdrawn actions are just not offered.
+// Once the table is full, entries which are not offered and not referred to by any timer in the system tables are reused
+std::vector<TimerAction> System::timer_actions;
+void (*System::timerHandler)(const Timer* /* timer */) __attribute__ ((weak)) = nullptr;
+int32_t System::timer_lateness = 0;
+uint32_t System::timer_lateness_hist[TIMER_LATENESS_BUCKETS] = {};
+uint32_t System::timer_missed = 0;
+uint32_t System::timer_skipped = 0;
+static const int32_t TIMER_LATENESS_BOUNDS[TIMER_LATENESS_BUCKETS - 1] = {10, 100, 1000, 10000, 60000}; // Upper bounds of lateness histogram buckets (ms)
+
+// Return timer action identifier, registering the name if unknown
+timer_action_t System::getTimerActionID(const String& name) {
+  if (timer_actions.empty())
+    timer_actions.push_back({F("undefined"), nullptr, 0, false});  // TIMER_ACTION_UNDEFINED
+  for (size_t i = 0; i < timer_actions.size(); i++)
+    if (timer_actions[i].name == name)
+      return i;
+  if (timer_actions.size() < TIMER_ACTION_MAX) {
+    timer_actions.push_back({name, nullptr, 0, false});
+    return timer_actions.size() - 1;
+  }
+
+  for (size_t i = TIMER_ACTION_UNDEFINED + 1; i < timer_actions.size(); i++)
+    if (!timer_actions[i].offered && !isTimerActionUsed(i)) {
+      timer_actions[i] = {name, nullptr, 0, false};
+      return i;
+    }
+#ifdef DS_CAP_SYS_LOG
+  log->printf(TIMED("Timer action table is full; action \"%s\" is undefined\n"), name.c_str());
+#endif // DS_CAP_SYS_LOG
+  return TIMER_ACTION_UNDEFINED;
+}
+
+// Return true if some timer in the system tables refers to an action
+//// Countdown timers via ticker are owned by the application and are not seen here; they normally use offered actions, which are never reused
+bool System::isTimerActionUsed(const timer_action_t id) {
+#ifdef DS_CAP_TIMERS_ABS
+  for (const auto& timer : timers)
+    if (timer.getType() != TIMER_INVALID && timer.getActionID() == id)
+      return true;
+#endif // DS_CAP_TIMERS_ABS
+#ifdef DS_CAP_TIMERS_COUNT_MS
+  for (const auto& timer : ms_timers)
+    if (timer.getType() != TIMER_INVALID && timer.getActionID() == id)
+      return true;
+#endif // DS_CAP_TIMERS_COUNT_MS
+  return false;
+}
+
+// Return timer action by identifier
+const TimerAction& System::getTimerAction(const timer_action_t id) {
+  if (timer_actions.empty())
+    getTimerActionID(F("undefined"));
+  return timer_actions[id < timer_actions.size() ? id : TIMER_ACTION_UNDEFINED];
+}
+
+// Offer timer action for configuration. Returns its identifier
+//// Handler receives the timer and the argument given here, so that actions differing by a number can share a handler
+timer_action_t System::addTimerAction(const String& name, timer_action_handler_t handler, const int32_t arg) {
+  const auto id = getTimerActionID(name);
+  if (id != TIMER_ACTION_UNDEFINED)
+    timer_actions[id] = {name, handler, arg, true};
+  return id;
+}
+
+// Withdraw timer action from configuration (timers using it keep the identifier)
+void System::removeTimerAction(const String& name) {
+  for (auto& action : timer_actions)
+    if (action.name == name) {
+      action.offered = false;
+      break;
+    }
+}
+
+// Call timer action handler. Returns false if action has no handler
+bool System::runTimerAction(const Timer* timer) {
+  const auto& action = getTimerAction(timer->getActionID());
+  if (!action.handler)
+    return false;
+  action.handler(timer, action.arg);
+  return true;
+}
+
+// Return how late the timer being fired is (ms)
+//// Only meaningful inside a timer action or handler. Timers from absolute time are checked once a second, so their lateness is a multiple of 1000
+int32_t System::getTimerLateness() {
+  return timer_lateness;
+}
+
+// Account for timer firing lateness (ms). Returns true if the action is to be run
+//// A missed firing (e.g., the loop was blocked by a Wi-Fi configuration session through the due second) is run late unless the timer
+//// policy says otherwise or it is just too late
+bool System::checkTimerLateness(const Timer* timer, const int32_t lateness) {
+  timer_lateness = lateness;
+  uint8_t bucket = 0;
+  while (bucket < TIMER_LATENESS_BUCKETS - 1 && lateness >= TIMER_LATENESS_BOUNDS[bucket])
+    bucket++;
+  timer_lateness_hist[bucket]++;
+  if (lateness < TIMER_MISSED_LATENESS)
+    return true;
+
+  timer_missed++;
+  const auto run = !timer->skipsMissed() && lateness / 1000 <= DS_TIMERS_RUN_LATE_MAX;
+  if (!run)
+    timer_skipped++;
+#ifdef DS_CAP_SYS_LOG
+  log->printf(TIMED("Timer \"%s\" missed by %d ms; %s\n"), timer->getAction().c_str(), lateness, run ? PSTR("running late") : PSTR("skipping"));
+#endif // DS_CAP_SYS_LOG
+  return run;
+}
+
+// Return timer lateness statistics in human-readable form
+String System::getTimerStats() {
+  static const char *const LABELS[TIMER_LATENESS_BUCKETS] PROGMEM = {"&lt;10 ms", "&lt;100 ms", "&lt;1 s", "&lt;10 s", "&lt;1 min", "1 min+"};
+  String stats;
+  for (uint8_t bucket = 0; bucket < TIMER_LATENESS_BUCKETS; bucket++) {
+    stats += FPSTR(LABELS[bucket]);
+    stats += F(": ");
+    stats += timer_lateness_hist[bucket];
+    stats += F(", ");
+  }
+  stats += F("missed: ");
+  stats += timer_missed;
+  stats += F(" (skipped: ");
+  stats += timer_skipped;
+  stats += F(")");
+  return stats;
+}
 #endif // DS_CAP_TIMERS
 
 
@@ -1486,107 +2086,211 @@ bool Timer::operator!=(const Timer& timer) const {
  *************************************************************************/
 #ifdef DS_CAP_TIMERS_ABS
 
+#include <algorithm>                 // Heap operations
+#include <functional>                // std::greater
+
 bool System::abs_timers_active = true;               // Activate timers
-std::forward_list<TimerAbsolute *> System::timers;
-void (*System::timerHandler)(const TimerAbsolute* /* timer */) __attribute__ ((weak)) = nullptr;
-
-// struct tm (re)use:
-//   int tm_sec;    - timer firing second (0..59)
-//   int tm_min;    - timer firing minute (0..59)
-//   int tm_hour;   - timer firing hour (0..23)
-//   int tm_mday;   - solar timer: timer offset (-59..+59 min)
-//       >>         - countdown timer: timer offset (0..86399 s < interval)
-//   int tm_mon;    - (not used)
-//   int tm_year;   - (not used)
-//   int tm_wday;   - timer firing day of the week (bitmask starting from Sunday, 0x7f == any day)
-//   int tm_yday;   - (not used)
-//   int tm_isdst;  - countdown timer: next firing time (time_t)
+Timer System::timers[DS_TIMERS_MAX];
+std::pair<time_t, Timer *> System::timer_queue[DS_TIMERS_MAX];
+uint16_t System::timer_queue_size = 0;
+bool System::timer_queue_valid = false;
 
 // Absolute timer constructor
-TimerAbsolute::TimerAbsolute(const String action, const uint8_t hour, const uint8_t minute, const uint8_t second,
+TimerAbsolute::TimerAbsolute(const String& action, const uint8_t hour, const uint8_t minute, const uint8_t second,
   const uint8_t dow, const bool armed, const bool recurrent, const bool transient, const int id) :
-  Timer(TIMER_ABSOLUTE, action, armed, recurrent, transient, id),
-  time({second <= 59 ? second : 0, minute <= 59 ? minute : 0, hour <= 23 ? hour : 0,
-    0, 0, 0, dow < TIMER_DOW_INVALID ? dow : TIMER_DOW_INVALID, 0, 0}) {}
+  Timer(TIMER_ABSOLUTE, action, armed, recurrent, transient, id) {
+  time = (hour <= 23 ? hour : 0) * 3600 + (minute <= 59 ? minute : 0) * 60 + (second <= 59 ? second : 0);
+  setDayOfWeek(dow);
+}
 
 // Return hour setting
-uint8_t TimerAbsolute::getHour() const {
-  return time.tm_hour;
+uint8_t Timer::getHour() const {
+  return time / 3600;
 }
 
 // Set hour setting
-void TimerAbsolute::setHour(const uint8_t new_hour) {
+void Timer::setHour(const uint8_t new_hour) {
   if (new_hour <= 23)
-    time.tm_hour = new_hour;
+    time = new_hour * 3600 + time % 3600;
 }
 
 // Return minute setting
-uint8_t TimerAbsolute::getMinute() const {
-  return time.tm_min;
+uint8_t Timer::getMinute() const {
+  return time / 60 % 60;
 }
 
 // Set minute setting
-void TimerAbsolute::setMinute(const uint8_t new_minute) {
+void Timer::setMinute(const uint8_t new_minute) {
   if (new_minute <= 59)
-    time.tm_min = new_minute;
+    time += (new_minute - getMinute()) * 60;
 }
 
 // Return second setting
-uint8_t TimerAbsolute::getSecond() const {
-  return time.tm_sec;
+uint8_t Timer::getSecond() const {
+  return time % 60;
 }
 
 // Set second setting
-void TimerAbsolute::setSecond(const uint8_t new_second) {
+void Timer::setSecond(const uint8_t new_second) {
   if (new_second <= 59)
-    time.tm_sec = new_second;
+    time += new_second - getSecond();
 }
 
 // Get day of week setting
-uint8_t TimerAbsolute::getDayOfWeek() const {
-  return time.tm_wday;
+uint8_t Timer::getDayOfWeek() const {
+  return dow;
 }
 
 // Set day of week setting
-void TimerAbsolute::setDayOfWeek(const uint8_t new_dow) {
-  time.tm_wday = new_dow < TIMER_DOW_INVALID ? new_dow : TIMER_DOW_INVALID;
+void Timer::setDayOfWeek(const uint8_t new_dow) {
+  dow = new_dow < TIMER_DOW_INVALID ? new_dow : TIMER_DOW_INVALID;
 }
 
 // Enable some day(s) of week
-void TimerAbsolute::enableDayOfWeek(const uint8_t new_dow) {
-  time.tm_wday |= new_dow < TIMER_DOW_INVALID ? new_dow : TIMER_DOW_NONE;
+void Timer::enableDayOfWeek(const uint8_t new_dow) {
+  dow |= new_dow < TIMER_DOW_INVALID ? new_dow : TIMER_DOW_NONE;
 }
 
 // Disable some day(s) of week
-void TimerAbsolute::disableDayOfWeek(const uint8_t new_dow) {
-  time.tm_wday &= new_dow < TIMER_DOW_INVALID ? ~new_dow : ~TIMER_DOW_NONE;
+void Timer::disableDayOfWeek(const uint8_t new_dow) {
+  dow &= new_dow < TIMER_DOW_INVALID ? ~new_dow : ~TIMER_DOW_NONE;
 }
 
-// Return absolute timer with a matching ID
-TimerAbsolute* System::getTimerAbsByID(const int id) {
-  auto it = std::find_if(timers.begin(), timers.end(), [=](const Timer *timer) { return timer && timer->getID() == id; } );
-  return it == timers.end() ? nullptr : *it;
+// Return offset (solar timer: min from event; countdown timer: s from midnight)
+int32_t Timer::getOffset() const {
+  return offset;
 }
 
-// Absolute timer comparison operator
-bool TimerAbsolute::operator==(const TimerAbsolute& timer) const {
-  return Timer::operator==(timer) && getHour() == timer.getHour() &&
-    getMinute() == timer.getMinute() && getSecond() == timer.getSecond() && getDayOfWeek() == timer.getDayOfWeek();
+// Set offset (solar timer: min from event; countdown timer: s from midnight)
+void Timer::setOffset(const int32_t new_offset) {
+  switch (type) {
+#ifdef DS_CAP_TIMERS_SOLAR
+    case TIMER_SUNRISE:
+    case TIMER_SUNSET:
+      if (new_offset >= -59 && new_offset <= 59) {
+        offset = new_offset;
+        adjust();  // Offset changed; recalculate time
+      }
+      break;
+#endif // DS_CAP_TIMERS_SOLAR
+#ifdef DS_CAP_TIMERS_COUNT_ABS
+    case TIMER_COUNTDOWN_ABS:
+      if (new_offset >= 0 && new_offset < time)
+        offset = new_offset;
+      break;
+#endif // DS_CAP_TIMERS_COUNT_ABS
+    default: ;  // Offset is not used
+  }
 }
 
-// Absolute timer comparison operator
-bool TimerAbsolute::operator!=(const TimerAbsolute& timer) const {
-  return !(*this == timer);
+// Return the first firing time after a given time (0 = never)
+time_t Timer::nextFiring(const time_t from_time) const {
+  switch (type) {
+    case TIMER_ABSOLUTE:      return nextFiringAbsolute(from_time);
+#ifdef DS_CAP_TIMERS_SOLAR
+    case TIMER_SUNRISE:
+    case TIMER_SUNSET:        return nextFiringSolar(from_time);
+#endif // DS_CAP_TIMERS_SOLAR
+#ifdef DS_CAP_TIMERS_COUNT_ABS
+    case TIMER_COUNTDOWN_ABS: return nextFiringCountdown(from_time);
+#endif // DS_CAP_TIMERS_COUNT_ABS
+    default:                  return 0;
+  }
+}
+
+// Return the first firing time of absolute timer
+//// Going via local time makes DST changes transparent. A time skipped by DST fires at the corresponding time after the change.
+//// A time repeated by DST fires only once
+time_t Timer::nextFiringAbsolute(const time_t from_time) const {
+  struct tm tm_from;
+  localtime_r(&from_time, &tm_from);
+  for (uint8_t day = 0; day <= 7; day++) {  // 8 days, as today's time might have passed already
+    struct tm tm_next = tm_from;
+    tm_next.tm_mday += day;
+    tm_next.tm_hour = getHour();
+    tm_next.tm_min = getMinute();
+    tm_next.tm_sec = getSecond();
+    tm_next.tm_isdst = -1;
+    const auto next_time = mktime(&tm_next);
+    if (!day && tm_next.tm_isdst < tm_from.tm_isdst && tm_from.tm_hour * 3600 + tm_from.tm_min * 60 + tm_from.tm_sec >= time)
+      continue;  // Time of day was already reached before the clocks were turned back
+    if (next_time > from_time && 1 << tm_next.tm_wday & getDayOfWeek())
+      return next_time;
+  }
+  return 0;
+}
+
+// Return timer with a matching ID (nullptr = not found)
+Timer* System::getTimerByID(const int id) {
+  for (auto& timer : timers)
+    if (timer.getType() != TIMER_INVALID && timer.getID() == id)
+      return &timer;
+  return nullptr;
+}
+
+// Add timer, replacing the one with the same ID, if any. Returns timer table entry (nullptr = table full)
+//// New timer takes the first free entry. Entries never move, so pointers to them stay valid until the timer is removed
+Timer* System::addTimer(const Timer& timer) {
+  if (timer.getType() == TIMER_INVALID)
+    return nullptr;
+  auto entry = timer.getID() == -1 ? nullptr : getTimerByID(timer.getID());
+  for (uint16_t i = 0; !entry && i < DS_TIMERS_MAX; i++)
+    if (timers[i].getType() == TIMER_INVALID)
+      entry = &timers[i];
+  if (entry) {
+    *entry = timer;
+    scheduleTimers();
+  }
+  return entry;
+}
+
+// Remove timer with a matching ID. Returns true if timer was found
+//// The entry is just marked as free, so timers can be removed while iterating over the table
+bool System::removeTimer(const int id) {
+  auto timer = getTimerByID(id);
+  if (!timer)
+    return false;
+  timer->setType(TIMER_INVALID);
+  scheduleTimers();
+  return true;
+}
+
+// Return number of timers in the table
+uint16_t System::getTimerCount() {
+  uint16_t n_timers = 0;
+  for (const auto& timer : timers)
+    if (timer.getType() != TIMER_INVALID)
+      n_timers++;
+  return n_timers;
+}
+
+// Add timer to the queue for its first firing after a given time
+void System::queueTimer(Timer* timer, const time_t from_time) {
+  const auto next_time = timer->nextFiring(from_time);
+  if (next_time && timer_queue_size < DS_TIMERS_MAX) {
+    timer_queue[timer_queue_size++] = std::make_pair(next_time, timer);
+    std::push_heap(timer_queue, timer_queue + timer_queue_size, std::greater<std::pair<time_t, Timer *>>());
+  }
+}
+
+// Rebuild timer queue for firings after a given time
+void System::buildTimerQueue(const time_t from_time) {
+  timer_queue_size = 0;
+  for (auto& timer : timers)
+    if (timer.getType() != TIMER_INVALID && timer.isArmed())
+      queueTimer(&timer, from_time);
+  timer_queue_valid = true;
 }
 
-// Time comparison operator
-bool TimerAbsolute::operator==(const struct tm& _tm) const {
-  return getHour() == _tm.tm_hour && getMinute() == _tm.tm_min && getSecond() == _tm.tm_sec && 1 << _tm.tm_wday & getDayOfWeek();
+// Request timer queue rebuild. To be called after changing timers
+//// Rebuild is deferred until the next timer check, so the queue never holds timers changed in between
+void System::scheduleTimers() {
+  timer_queue_valid = false;
 }
 
-// Time comparison operator
-bool TimerAbsolute::operator!=(const struct tm& _tm) const {
-  return !(*this == _tm);
+// Return next timer firing time (0 = none or unknown yet)
+time_t System::getNextTimerTime() {
+  return timer_queue_valid && timer_queue_size ? timer_queue[0].first : 0;
 }
 
 #endif // DS_CAP_TIMERS_ABS
@@ -1599,75 +2303,167 @@ bool TimerAbsolute::operator!=(const struct tm& _tm) const {
  *************************************************************************/
 #ifdef DS_CAP_TIMERS_SOLAR
 
-#include <Dusk2Dawn.h>              // Sunrise/sunset calculation, https://github.com/dmkishi/Dusk2Dawn  (! get the latest master via ZIP, not v1.0.1 from Arduino IDE !)
+// Solar times are looked up in a yearly table of sunrise and sunset times, computed at boot for DS_LATITUDE and DS_LONGITUDE.
+// Computation uses integer math (ESP8266 has no FPU) and NOAA approximations; it agrees with the floating point formulas within a minute
+static int16_t solar_table[366][2];          // Sunrise and sunset by day of year (minutes from UTC midnight; might be out of 0..1439)
+static bool solar_table_ok = false;          // True if solar table has been computed
+
+// Quarter sine wave in Q14 (16384 = 1), 64 steps
+static const uint16_t SINE_Q14[65] PROGMEM = {
+      0,   402,   804,  1205,  1606,  2006,  2404,  2801,  3196,  3590,  3981,  4370,  4756,  5139,  5520,  5897,
+   6270,  6639,  7005,  7366,  7723,  8076,  8423,  8765,  9102,  9434,  9760, 10080, 10394, 10702, 11003, 11297,
+  11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+  15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+  16384};
+
+// Return sine of a binary angle (65536 = full turn) in Q14
+static int32_t sinQ14(const uint16_t angle) {
+  const uint16_t quarter = angle >> 14;
+  uint16_t a = angle & 0x3fff;
+  if (quarter & 1)
+    a = 0x4000 - a;
+  const uint16_t i = a >> 8, f = a & 0xff;
+  int32_t v = pgm_read_word(&SINE_Q14[i]);
+  if (i < 64)
+    v += ((int32_t)pgm_read_word(&SINE_Q14[i + 1]) - v) * f >> 8;
+  return quarter & 2 ? -v : v;
+}
+
+// Return cosine of a binary angle in Q14
+static int32_t cosQ14(const uint16_t angle) {
+  return sinQ14(angle + 0x4000);
+}
+
+// Return arc cosine of a Q14 value as a binary angle (0..32768)
+static uint16_t acosQ14(const int32_t x) {
+  uint16_t lo = 0, hi = 0x8000;
+  while (hi - lo > 1) {
+    const uint16_t mid = (lo + hi) / 2;
+    if (cosQ14(mid) > x)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return hi;
+}
+
+// Return seconds rounded to minutes
+static int16_t roundToMinutes(const int32_t sec) {
+  return sec >= 0 ? (sec + 30) / 60 : -((-sec + 30) / 60);
+}
+
+// Compute solar table
+//// Coefficients are those of NOAA series for equation of time (here, in s) and declination (here, in binary angle units)
+static void computeSolarTable() {
+  static const uint16_t LAT = (int32_t)(DS_LATITUDE * 65536 / 360);   // Latitude (binary angle; folded by the compiler)
+  static const int32_t LON = DS_LONGITUDE * 240;                      // Longitude (s; 4 min per degree)
+  static const int32_t SIN_H0 = -238;                                 // Sine of the sun altitude at sunrise (-0.833 deg, Q14)
+
+  const auto sin_lat = sinQ14(LAT), cos_lat = cosQ14(LAT);
+  for (uint16_t day = 0; day < 366; day++) {
+    const uint16_t g = (uint32_t)day * 65536 / 365;   // Fractional year
+    const auto s1 = sinQ14(g),     c1 = cosQ14(g);
+    const auto s2 = sinQ14(2 * g), c2 = cosQ14(2 * g);
+    const auto s3 = sinQ14(3 * g), c3 = cosQ14(3 * g);
+    const int32_t eot = 1 + (26 * c1 - 441 * s1 - 201 * c2 - 562 * s2) / 16384;
+    const int32_t decl = 72 + (-4171 * c1 + 733 * s1 - 70 * c2 + 9 * s2 - 28 * c3 + 15 * s3) / 16384;
+
+    // Hour angle of sunrise. Polar day and night make it 180 and 0 degrees respectively
+    const int32_t num = SIN_H0 * 16384 - sin_lat * sinQ14(decl);
+    const int32_t den = cos_lat * cosQ14(decl) >> 14;
+    uint16_t ha;
+    if (den <= 0 || num >= 16384 * den)
+      ha = 0;
+    else if (num <= -16384 * den)
+      ha = 0x8000;
+    else
+      ha = acosQ14(num / den);
+
+    const int32_t noon = 43200 - LON - eot;          // Solar noon (s from UTC midnight)
+    const int32_t ha_sec = (int32_t)ha * 675 / 512;  // 86400 s per 65536
+    solar_table[day][0] = roundToMinutes(noon - ha_sec);
+    solar_table[day][1] = roundToMinutes(noon + ha_sec);
+  }
+  solar_table_ok = true;
+}
 
 // Solar timer constructor
-TimerSolar::TimerSolar(const String action, const timer_type_t _type, const int8_t offset,
+TimerSolar::TimerSolar(const String& action, const timer_type_t _type, const int8_t offset,
   const uint8_t dow, const bool armed, const bool recurrent, const bool transient, const int id) :
-  Timer(_type == TIMER_SUNRISE || _type == TIMER_SUNSET ? _type : TIMER_INVALID, action, armed, recurrent, transient, id),
-  TimerAbsolute(action, 0, 0, 0, dow) {
+  Timer(_type == TIMER_SUNRISE || _type == TIMER_SUNSET ? _type : TIMER_INVALID, action, armed, recurrent, transient, id) {
+  setDayOfWeek(dow);
   setOffset(offset >= -59 && offset <= 59 ? offset : 0);
 }
 
-// Return offset in minutes from event
-int8_t TimerSolar::getOffset() const {
-  return time.tm_mday;
-}
-
-// Set offset in minutes from event
-void TimerSolar::setOffset(const int8_t offset) {
-  if (offset >= -59 && offset <= 59) {
-    time.tm_mday = offset;
-    adjust();  // Offset changed; recalculate time
+// Recalculate alignment to solar times (solar timer)
+//// Hour and minute reflect today's event. Event shifted over midnight by offset is shown at its time of day
+void Timer::adjust() {
+  if (type != TIMER_SUNRISE && type != TIMER_SUNSET)
+    return;
+  const auto sun_time = (type == TIMER_SUNRISE ? System::getSunrise() : System::getSunset()) + getOffset();
+  time = (sun_time + 24 * 60) % (24 * 60) * 60;  // Calculation has minute precision
+}
+
+// Return the first firing time of solar timer
+//// Day of week applies to the day of the solar event, even if offset moves firing over midnight
+time_t Timer::nextFiringSolar(const time_t from_time) const {
+  struct tm tm_from;
+  localtime_r(&from_time, &tm_from);
+  for (int8_t day = -1; day <= 7; day++) {  // Yesterday's event might fire today
+    struct tm tm_day = tm_from;
+    tm_day.tm_mday += day;
+    tm_day.tm_hour = 12;
+    tm_day.tm_min = tm_day.tm_sec = 0;
+    tm_day.tm_isdst = -1;
+    mktime(&tm_day);
+    if (!(1 << tm_day.tm_wday & getDayOfWeek()))
+      continue;
+    const auto next_time = System::getSolarEvent((timer_type_t)type, tm_day) + getOffset() * 60;
+    if (next_time > from_time)
+      return next_time;
   }
-}
-
-// Recalculate alignment to solar times
-void TimerSolar::adjust() {
-  const auto sun_time = type == TIMER_SUNRISE ? System::getSunrise() : System::getSunset();
-
-  // This might not work properly with solar events happening shortly past midnight, but these are unlikely
-  setHour((sun_time + getOffset()) / 60);
-  setMinute((sun_time + getOffset()) % 60);
-  setSecond(0);  // Calculation has minute precision
-}
-
-// Solar timer comparison operator
-bool TimerSolar::operator==(const TimerSolar& timer) const {
-  return Timer::operator==(timer) && getDayOfWeek() == timer.getDayOfWeek() && getOffset() == timer.getOffset();
-}
-
-// Solar timer comparison operator
-bool TimerSolar::operator!=(const TimerSolar& timer) const {
-  return !(*this == timer);
-}
-
-uint16_t System::getSolarEvent(const timer_type_t ev_type) {
-
-  // Dusk2Dawn expects TZ east to GMT, whereas POSIX TZ goes west, hence the minus sign
-  Dusk2Dawn local(DS_LONGITUDE, DS_LATITUDE, -_timezone / 60.0 / 60);
-
+  return 0;
+}
+
+// Return solar event time on a given day
+//// Time is counted from the UTC midnight of the local date, which makes time zone and DST irrelevant
+time_t System::getSolarEvent(const timer_type_t ev_type, const struct tm& day) {
+  if (!solar_table_ok)
+    computeSolarTable();
+  struct tm tm_noon = day;
+  tm_noon.tm_hour = 12;
+  tm_noon.tm_min = tm_noon.tm_sec = 0;
+  tm_noon.tm_isdst = -1;
+  mktime(&tm_noon);
+
+  // Days from the epoch to 1 January of the year, counting the leap days (Gregorian rules) in between. Rounding the local noon down
+  // to a UTC day would give the previous date with UTC offsets of 12 h and more
+  const long year = tm_noon.tm_year + 1900;
+  const long days = 365 * (year - 1970) + (year - 1969) / 4 - (year - 1901) / 100 + (year - 1601) / 400 + tm_noon.tm_yday;
+  const auto midnight_utc = (time_t)days * 24 * 60 * 60;
   switch (ev_type) {
-
-    case TIMER_SUNRISE:
-      return local.sunrise(tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday, tm_time.tm_isdst);
-
-    case TIMER_SUNSET:
-      return local.sunset (tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday, tm_time.tm_isdst);
-
-    default:
-      return 0;
+    case TIMER_SUNRISE: return midnight_utc + solar_table[tm_noon.tm_yday][0] * 60;
+    case TIMER_SUNSET:  return midnight_utc + solar_table[tm_noon.tm_yday][1] * 60;
+    default:            return 0;
   }
 }
 
+// Return time of a solar event today (in minutes from midnight)
+static uint16_t getSolarMinutes(const timer_type_t ev_type) {
+  const auto event_time = System::getSolarEvent(ev_type, System::tm_time);
+  struct tm tm_event;
+  localtime_r(&event_time, &tm_event);
+  return tm_event.tm_hour * 60 + tm_event.tm_min;
+}
+
 // Return sunrise time (in minutes from midnight)
 uint16_t System::getSunrise() {
-  return getSolarEvent(TIMER_SUNRISE);
+  return getSolarMinutes(TIMER_SUNRISE);
 }
 
 // Return sunset time (in minutes from midnight)
 uint16_t System::getSunset() {
-  return getSolarEvent(TIMER_SUNSET);
+  return getSolarMinutes(TIMER_SUNSET);
 }
 
 #endif // DS_CAP_TIMERS_SOLAR
@@ -1675,143 +2471,59 @@ uint16_t System::getSunset() {
 
 
 
-/*************************************************************************
- * Capability: countdown timers
- *************************************************************************/
-#if defined(DS_CAP_TIMERS_COUNT_ABS) || defined(DS_CAP_TIMERS_COUNT_TICK)
-
-// Countdown timer constructor
-TimerCountdown::TimerCountdown(const timer_type_t type, const String action, const float _interval,
-  const bool armed, const bool recurrent, const bool transient, const int id) :
-  Timer(type, action, armed, recurrent, transient, id) {
-    setInterval(_interval > 0 ? _interval : 1);
-}
-
-// Define pure virtual destructor (required by C++)
-TimerCountdown::~TimerCountdown() {
-}
-
-// Return timer interval (s)
-float TimerCountdown::getInterval() const {
-  return interval;
-}
-
-// Set timer interval (s)
-void TimerCountdown::setInterval(const float _interval) {
-  if (_interval > 0)
-    interval = _interval;
-}
-
-// Countdown timer comparison operator
-bool TimerCountdown::operator==(const TimerCountdown& timer) const {
-  return Timer::operator==(timer) && getInterval() == timer.getInterval();
-}
-
-// Countdown timer comparison operator
-bool TimerCountdown::operator!=(const TimerCountdown& timer) const {
-  return !(*this == timer);
-}
-
-#endif // DS_CAP_TIMERS_COUNT_ABS || DS_CAP_TIMERS_COUNT_TICK
-
-
-
-
 /*************************************************************************
  * Capability: countdown timers, counting via absolute time
  *************************************************************************/
- #ifdef DS_CAP_TIMERS_COUNT_ABS
+#ifdef DS_CAP_TIMERS_COUNT_ABS
 
 // Countdown timer constructor
-TimerCountdownAbs::TimerCountdownAbs(const String action, const float _interval, const uint32_t offset,
+TimerCountdownAbs::TimerCountdownAbs(const String& action, const uint32_t interval, const uint32_t offset,
   const uint8_t dow, const bool armed, const bool recurrent, const bool transient, const int id) :
-  Timer(TIMER_COUNTDOWN_ABS, action, armed, recurrent, transient, id),
-  TimerCountdown(TIMER_COUNTDOWN_ABS),
-  TimerAbsolute(action, 0, 0, 0, dow) {
-    setInterval(_interval <= 24 * 60 * 60 ? (_interval > 0 ? _interval : 1) : 24 * 60 * 60);
-    setOffset(offset < getInterval() ? offset : 0);
-    setNextTime(0);  // Next firing time. Setting it to 0 will force recalculation
+  Timer(TIMER_COUNTDOWN_ABS, action, armed, recurrent, transient, id) {
+  setDayOfWeek(dow);
+  setInterval(interval <= 24 * 60 * 60 ? (interval > 0 ? interval : 1) : 24 * 60 * 60);
+  setOffset(offset < getInterval() ? offset : 0);
 }
 
-// Return next firing time
-time_t TimerCountdownAbs::getNextTime() const {
-  return time.tm_isdst;
+// Return timer interval (s; countdown timer)
+uint32_t Timer::getInterval() const {
+  return type == TIMER_COUNTDOWN_ABS ? time : 0;
 }
 
-// Set next firing time
-void TimerCountdownAbs::setNextTime(const time_t new_time) {
-  time.tm_isdst = new_time;
-}
-
-// Return timer interval (s)
-float TimerCountdownAbs::getInterval() const {
-  return TimerCountdown::getInterval();
-}
-
-// Set timer interval (s)
-void TimerCountdownAbs::setInterval(const float _interval) {
-  if (_interval > 0 && _interval <= 24 * 60 * 60)
-    TimerCountdown::setInterval(_interval);
-  if (getOffset() >= getInterval())
-    setOffset(0);
-}
-
-// Return timer offset in seconds from midnight
-uint32_t TimerCountdownAbs::getOffset() const {
-  return time.tm_mday;
-}
-
-// Set timer offset in seconds from midnight
-void TimerCountdownAbs::setOffset(const uint32_t offset) {
-  if (offset < getInterval())
-    time.tm_mday = offset;
+// Set timer interval (s; countdown timer)
+void Timer::setInterval(const uint32_t new_interval) {
+  if (type != TIMER_COUNTDOWN_ABS || !new_interval || new_interval > 24 * 60 * 60)
+    return;
+  time = new_interval;
+  if (offset >= time)
+    offset = 0;
 }
 
-// Prepare timer for firing
-void TimerCountdownAbs::update(const time_t from_time) {
+// Return the first firing time of countdown timer
+//// Firings are counted from each day's midnight plus offset, so countdown gets rebased every day
+time_t Timer::nextFiringCountdown(const time_t from_time) const {
   const uint32_t interval = getInterval();
-  auto next_time = getNextTime();
-  const auto cur_time = from_time ? from_time : System::time;
-  if (next_time > cur_time && next_time - cur_time < (int) interval)
-    return;     // Countdown goes as planned
-
-  if (next_time == cur_time) {     // Timer fired
-    setNextTime(next_time + interval);
-    auto next = getSecond() + interval;
-    setSecond(next % 60);
-    auto leap = next / 60;
-    next = getMinute() + leap;
-    setMinute(next % 60);
-    leap = next / 60;
-    setHour((getHour() + leap) % 24);
-    return;
+  struct tm tm_from;
+  localtime_r(&from_time, &tm_from);
+  for (uint8_t day = 0; day <= 7; day++) {
+    struct tm tm_day = tm_from;
+    tm_day.tm_mday += day;
+    tm_day.tm_hour = tm_day.tm_min = tm_day.tm_sec = 0;
+    tm_day.tm_isdst = -1;
+    const auto midnight = mktime(&tm_day);
+    if (!(1 << tm_day.tm_wday & getDayOfWeek()))
+      continue;
+    tm_day.tm_mday++;
+    tm_day.tm_isdst = -1;
+    const auto next_midnight = mktime(&tm_day);
+
+    auto next_time = midnight + getOffset();
+    if (next_time <= from_time)
+      next_time += ((from_time - next_time) / interval + 1) * interval;
+    if (next_time < next_midnight)
+      return next_time;
   }
-
-  // Otherwise we are out of sync and need to rebase the timer
-  const auto offset = getOffset();
-  struct tm tm_now, tm_ref;
-  localtime_r(&cur_time, &tm_now);
-  tm_ref = tm_now;
-  tm_ref.tm_hour = offset / (60 * 60);
-  tm_ref.tm_min = (offset - 60 * 60 * tm_ref.tm_hour) / 60;
-  tm_ref.tm_sec = offset % 60;
-  const auto tdiff = interval - abs(cur_time - mktime(&tm_ref)) % interval;
-  setNextTime(cur_time + tdiff);
-  setSecond((tm_now.tm_sec + tdiff) % 60);
-  auto leap = (tm_now.tm_sec + tdiff) / 60;
-  setMinute((tm_now.tm_min + leap) % 60);
-  leap = (tm_now.tm_min + leap) / 60;
-  setHour((tm_now.tm_hour + leap) % 24);
-}
-
-// Countdown timer comparison operator
-bool TimerCountdownAbs::operator==(const TimerCountdownAbs& timer) const {
-  return Timer::operator==(timer) && getInterval() == timer.getInterval() && getOffset() == timer.getOffset();
-}
-
-// Countdown timer comparison operator
-bool TimerCountdownAbs::operator!=(const TimerCountdownAbs& timer) const {
-  return !(*this == timer);
+  return 0;
 }
 
 #endif // DS_CAP_TIMERS_COUNT_ABS
@@ -1825,20 +2537,31 @@ bool TimerCountdownAbs::operator!=(const TimerCountdownAbs& timer) const {
 #ifdef DS_CAP_TIMERS_COUNT_TICK
 
 // Countdown timer constructor
-TimerCountdownTick::TimerCountdownTick(const String action, const float _interval, Ticker::callback_function_t _callback,
+TimerCountdownTick::TimerCountdownTick(const String& action, const float _interval, Ticker::callback_function_t _callback,
   const bool armed, const bool recurrent, const bool transient, const int id) :
-  Timer(TIMER_COUNTDOWN_TICK, action, armed, recurrent, transient, id),
-  TimerCountdown(TIMER_COUNTDOWN_TICK, action, _interval), callback(_callback) {
+  Timer(TIMER_COUNTDOWN_TICK, action, armed, recurrent, transient, id), interval(1), callback(_callback) {
+    setInterval(_interval);
     if (armed)
       arm();
 }
 
+// Return timer interval (s)
+float TimerCountdownTick::getInterval() const {
+  return interval;
+}
+
+// Set timer interval (s)
+void TimerCountdownTick::setInterval(const float _interval) {
+  if (_interval > 0)
+    interval = _interval;
+}
+
 // Arm the timer (default)
 void TimerCountdownTick::arm() {
   if (callback) {
     if (!ticker.active()) {
       Timer::arm();
-      if (recurrent)
+      if (isRecurrent())
         ticker.attach_ms_scheduled(1000 * interval, callback);
       else
         ticker.once_ms_scheduled(1000 * interval, callback);
@@ -1857,7 +2580,7 @@ void TimerCountdownTick::disarm() {
 
 // Make timer repetitive (default)
 void TimerCountdownTick::repeatForever() {
-  if (!recurrent) {
+  if (!isRecurrent()) {
     Timer::repeatForever();
     if(isArmed()) {
       disarm();
@@ -1868,7 +2591,7 @@ void TimerCountdownTick::repeatForever() {
 
 // Make timer a one-time shot
 void TimerCountdownTick::repeatOnce() {
-  if (recurrent) {
+  if (isRecurrent()) {
     Timer::repeatOnce();
     if(isArmed()) {
       disarm();
@@ -1887,7 +2610,127 @@ bool TimerCountdownTick::operator!=(const TimerCountdownTick& timer) const {
   return !(*this == timer);
 }
 
-#endif // DS_CAP_TIMERS_COUNT_ABS
+#endif // DS_CAP_TIMERS_COUNT_TICK
+
+
+
+
+/*************************************************************************
+ * Capability: countdown timers with millisecond precision, counting via millis()
+ *************************************************************************/
+#ifdef DS_CAP_TIMERS_COUNT_MS
+
+Timer System::ms_timers[DS_TIMERS_MS_MAX];
+unsigned long System::ms_timer_next = 0;
+bool System::ms_timer_next_valid = false;
+
+// Millisecond countdown timer constructor
+TimerCountdownMs::TimerCountdownMs(const String& action, const uint32_t interval, const bool armed, const bool recurrent,
+  const bool transient, const int id) :
+  Timer(TIMER_COUNTDOWN_MS, action, armed, recurrent, transient, id) {
+    setIntervalMs(interval);
+    if (armed)
+      arm();
+}
+
+// Return timer interval (ms; millisecond countdown timer)
+uint32_t Timer::getIntervalMs() const {
+  return type == TIMER_COUNTDOWN_MS ? time : 0;
+}
+
+// Set timer interval (ms; millisecond countdown timer). Takes effect when rearmed
+void Timer::setIntervalMs(const uint32_t new_interval) {
+  if (type == TIMER_COUNTDOWN_MS)
+    time = new_interval > 0 ? (new_interval <= INT32_MAX ? new_interval : INT32_MAX) : 1;
+}
+
+// Return next firing time (millis(); millisecond countdown timer)
+unsigned long Timer::getDeadline() const {
+  return type == TIMER_COUNTDOWN_MS ? (uint32_t)offset : 0;
+}
+
+// Set next firing time (millis(); millisecond countdown timer)
+void Timer::setDeadline(const unsigned long deadline) {
+  if (type == TIMER_COUNTDOWN_MS)
+    offset = (uint32_t)deadline;
+}
+
+// Return millisecond timer with a matching ID (nullptr = not found)
+Timer* System::getMsTimerByID(const int id) {
+  for (auto& timer : ms_timers)
+    if (timer.getType() != TIMER_INVALID && timer.getID() == id)
+      return &timer;
+  return nullptr;
+}
+
+// Add millisecond timer, replacing the one with the same ID, if any. Returns timer table entry (nullptr = table full)
+Timer* System::addMsTimer(const TimerCountdownMs& timer) {
+  if (timer.getType() == TIMER_INVALID)
+    return nullptr;
+  auto entry = timer.getID() == -1 ? nullptr : getMsTimerByID(timer.getID());
+  for (uint8_t i = 0; !entry && i < DS_TIMERS_MS_MAX; i++)
+    if (ms_timers[i].getType() == TIMER_INVALID)
+      entry = &ms_timers[i];
+  if (entry) {
+    *entry = timer;
+    scheduleMsTimers();
+  }
+  return entry;
+}
+
+// Remove millisecond timer with a matching ID. Returns true if timer was found
+bool System::removeMsTimer(const int id) {
+  auto timer = getMsTimerByID(id);
+  if (!timer)
+    return false;
+  timer->setType(TIMER_INVALID);
+  scheduleMsTimers();
+  return true;
+}
+
+// Request earliest deadline recalculation. To be called after changing millisecond timers
+void System::scheduleMsTimers() {
+  ms_timer_next_valid = false;
+}
+
+// Fire millisecond timers that are due
+//// Called on every loop pass, so unless some timer is due, only the earliest deadline is looked at.
+//// Recurrent timers keep their phase: a timer late by more than its interval skips the missed periods rather than catching up
+void System::updateMsTimers() {
+  auto now = millis();
+  if (ms_timer_next_valid && (long)(now - ms_timer_next) < 0)
+    return;
+
+  ms_timer_next_valid = true;                  // Timer actions changing the table make it false again
+  ms_timer_next = now + INT32_MAX;             // Nothing armed: look again in ~25 days
+  for (auto& timer : ms_timers) {
+    if (timer.getType() == TIMER_INVALID || !timer.isArmed())
+      continue;
+    const auto deadline = timer.getDeadline();
+    const auto lateness = (long)(now - deadline);
+    if (lateness >= 0) {
+      if (checkTimerLateness(&timer, lateness) && !runTimerAction(&timer) && timerHandler)
+        timerHandler(&timer);
+      now = millis();
+      if (timer.getType() == TIMER_INVALID || timer.isTransient()) {
+        timer.setType(TIMER_INVALID);
+        continue;
+      }
+      if (timer.getDeadline() == deadline) {   // Not rearmed by the action
+        if (timer.isRecurrent())
+          timer.setDeadline(deadline + (lateness / timer.getIntervalMs() + 1) * timer.getIntervalMs());
+        else
+          timer.disarm();
+      }
+      if (!timer.isArmed())
+        continue;
+    }
+    if ((long)(timer.getDeadline() - ms_timer_next) < 0)
+      ms_timer_next = timer.getDeadline();
+  }
+}
+
+#endif // DS_CAP_TIMERS_COUNT_MS
 
 
 
@@ -1941,9 +2784,29 @@ void System::begin() {
 #endif // DS_CAP_SYS_LOG
 #endif // DS_CAP_BUTTON
 
+#ifdef DS_CAP_SYS_RTCMEM
+  // Must be done before installing the time sync handler, as restoring the clock is not a time sync
+#ifdef DS_CAP_SYS_LOG
+  log->printf(TIMED("Recovering state from RTC memory... "));
+  log->println(loadRTCSnapshot() ? F("OK") : F("none found"));
+#else
+  loadRTCSnapshot();
+#endif // DS_CAP_SYS_LOG
+#endif // DS_CAP_SYS_RTCMEM
+
 #ifdef DS_CAP_SYS_TIME
   setTZ(DS_TIMEZONE);
-  localtime_r(&time, &tm_time);
+  resetCalendar();
+
+#ifdef DS_CAP_TIMERS_SOLAR
+#ifdef DS_CAP_SYS_LOG
+  log->printf(TIMED("Computing solar events... "));
+#endif // DS_CAP_SYS_LOG
+  computeSolarTable();
+#ifdef DS_CAP_SYS_LOG
+  log->println(F("OK"));
+#endif // DS_CAP_SYS_LOG
+#endif // DS_CAP_TIMERS_SOLAR
 
   // Install time sync handler
   settimeofday_cb(timeSyncHandler);
@@ -1963,81 +2826,10 @@ void System::begin() {
   log->printf(TIMED("Loading timers... "));
 #endif // DS_CAP_SYS_LOG
 
-  timers_cfg_name = DS_SYS_FOLDER_NAME;
-  timers_cfg_name += F("/");
-  timers_cfg_name += TIMERS_CFG_NAME;
-  timers_cfg_name.replace(F("."), String(TIMERS_CFG_VERSION) + F("."));
-  auto cfg_file = fs.open(timers_cfg_name, "r");
-  if (cfg_file) {
-
-    // Read global flag
-    String line = cfg_file.readStringUntil('\n');
-    abs_timers_active = line.toInt();
-
-    // Parse timer configuration. Format:
-    // |       |   action   | active | day of week |  type  |  hours  | mins | diff (optional) |
-    //      aT('lamp on'    ,      1 ,          127, 'at'   , 'sunset', 15   ,             '-' );
-    uint8_t tid = 0;
-    while (cfg_file.available()) {
-      line = cfg_file.readStringUntil('\n');
-      line.trim();
-      if (!line.startsWith(F("aT(")))
-        continue;
-
-      tid++;
-      line.remove(0, line.indexOf('\'') + 1);
-      const String action = line.substring(0, line.indexOf('\''));
-
-      line.remove(0, line.indexOf(',') + 1);
-      line.trim();
-      const bool active = line.toInt();
-
-      line.remove(0, line.indexOf(',') + 1);
-      line.trim();
-      const auto dow = (uint8_t)line.toInt();
-
-      line.remove(0, line.indexOf('\'') + 1);
-      const String at = line.substring(0, line.indexOf('\''));
-
-      line.remove(0, line.indexOf(',') + 1);
-      line.trim();
-      String solar_type;
-      uint16_t hour = 0;
-      if (line[0] == '\'') {
-        line.remove(0, 1);
-        solar_type = line.substring(0, line.indexOf('\''));
-      } else
-        hour = line.toInt();
-
-      line.remove(0, line.indexOf(',') + 1);
-      line.trim();
-      int16_t minute = line.toInt();
-
-      if (line.indexOf(',') != -1) {
-        line.remove(0, line.indexOf('\'') + 1);
-        if (line[0] == '-')
-          minute = -minute;
-      }
-
-      // Create timer
-      TimerAbsolute *timer = nullptr;
-      if (at == F("at")) {
-        if (solar_type.length())
-          timer = new TimerSolar(action, solar_type == F("sunrise") ? TIMER_SUNRISE : TIMER_SUNSET, minute, dow, active, true, false, tid);
-        else
-          timer = new TimerAbsolute(action, hour, minute, 0, dow, active, true, false, tid);
-      } else
-      if (at == F("every"))
-
-        // x60 because timer has seconds' resolution, but user specifies time in minutes
-        timer = new TimerCountdownAbs(action, hour * 60, minute * 60, dow, active, true, false, tid);
-      if (timer)
-        timers.push_front(timer);
-    }
-    cfg_file.close();
-    timers.reverse();
+  timers_cfg_name = timersCfgName(TIMERS_CFG_VERSION);
+  if (loadTimers()) {
 #ifdef DS_CAP_SYS_LOG
-    log->print(std::distance(timers.begin(), timers.end()));
+    log->print(getTimerCount());
     log->println(F(" found"));
 #endif // DS_CAP_SYS_LOG
   } else {
@@ -2213,6 +3005,10 @@ void System::update() {
   web_server.handleClient();
 #endif // DS_CAP_WEBSERVER
 
+#ifdef DS_CAP_TIMERS_COUNT_MS
+  updateMsTimers();
+#endif // DS_CAP_TIMERS_COUNT_MS
+
 #ifdef DS_CAP_TIMERS_ABS
   if (newSecond()) {
 #ifdef DS_CAP_TIMERS_SOLAR
@@ -2224,37 +3020,42 @@ void System::update() {
 #ifdef DS_CAP_SYS_LOG
       log->printf(TIMED("Recalculating solar events... "));
 #endif // DS_CAP_SYS_LOG
-      for (auto timer : timers)
-        if (timer && (timer->getType() == TIMER_SUNRISE || timer->getType() == TIMER_SUNSET))
-          static_cast<TimerSolar *>(timer)->adjust();
+      for (auto& timer : timers)
+        timer.adjust();
 #ifdef DS_CAP_SYS_LOG
       log->println(F("OK"));
 #endif // DS_CAP_SYS_LOG
     }
 #endif // DS_CAP_TIMERS_SOLAR
 
-    // Process timers
-    if (abs_timers_active && time_sync_status != TIME_SYNC_NONE)
-      for (auto timer : timers) {
-        if (timer && timer->getType() != TIMER_INVALID && timer->isArmed() && *timer == tm_time) {
+    // Process timers. Only the head of the queue needs to be looked at
+    if (abs_timers_active && time_sync_status != TIME_SYNC_NONE) {
+      if (!timer_queue_valid)
+        buildTimerQueue(time - 1);
+      while (timer_queue_valid && timer_queue_size && timer_queue[0].first <= time) {
+        std::pop_heap(timer_queue, timer_queue + timer_queue_size, std::greater<std::pair<time_t, Timer *>>());
+        const auto entry = timer_queue[--timer_queue_size];
+        auto timer = entry.second;
+        if (timer->getType() == TIMER_INVALID || !timer->isArmed())
+          continue;
+        const int64_t lateness = (int64_t)(time - entry.first) * 1000 + (millis() - time_millis);  // Clamped below, as a large clock jump would overflow 32 bits
+        if (checkTimerLateness(timer, lateness < INT32_MAX ? lateness : INT32_MAX)) {
 #ifdef DS_CAP_SYS_LOG
           log->printf(TIMED("Timer \"%s\" fired\n"), timer->getAction().c_str());
 #endif // DS_CAP_SYS_LOG
-          if (timerHandler)
+          if (!runTimerAction(timer) && timerHandler)
             timerHandler(timer);
-          if (timer->getType() == TIMER_INVALID || timer->isTransient()) {
-            timers.remove(timer);
-            continue;
-          }
-          if (!timer->isRecurrent())
-            timer->disarm();
         }
-#ifdef DS_CAP_TIMERS_COUNT_ABS
-        if (timer->getType() == TIMER_COUNTDOWN_ABS) {
-          static_cast<TimerCountdownAbs *>(timer)->update(time);
+        if (timer->getType() == TIMER_INVALID || timer->isTransient()) {
+          timer->setType(TIMER_INVALID);   // Timer is not in the queue anymore, so freeing its entry is enough
+          continue;
         }
-#endif // DS_CAP_TIMERS_COUNT_ABS
+        if (timer->isRecurrent())
+          queueTimer(timer, time);
+        else
+          timer->disarm();
       }
+    }
   }
 #endif // DS_CAP_TIMERS_ABS
 
@@ -2268,33 +3069,71 @@ void System::update() {
   setTimeSyncStatus(time_sync_time ? ((unsigned int)(time - time_sync_time) < 2 * DS_TIME_UPDATE_PERIOD ? TIME_SYNC_OK : TIME_SYNC_DEGRADED) : TIME_SYNC_NONE);
 
   time_change_flags = TIME_CHANGE_NONE;
-  const auto time_new = ::time(nullptr);
+  const auto time_new = DS_TIME_SOURCE();
   if (time != time_new) {
+#ifdef DS_CAP_TIMERS_ABS
+    if (time_new < time)        // Time went back; on a jump forward, firings due in between stay queued and are found missed
+      scheduleTimers();
+#endif // DS_CAP_TIMERS_ABS
+    const auto tick = time_new - time == 1 && time_new < calendar_end;
     time = time_new;
-    struct tm tm_time_new;
-    localtime_r(&time_new, &tm_time_new);
+    time_millis = millis();
 
-    if (tm_time.tm_sec != tm_time_new.tm_sec) {   // Normally always true in this context
+    if (tick) {                                   // Normal case: advance the calendar by one second
       time_change_flags |= TIME_CHANGE_SECOND;
-      if (tm_time.tm_min != tm_time_new.tm_min) {
+      if (++tm_time.tm_sec == 60) {
+        tm_time.tm_sec = 0;
+        time_change_flags |= TIME_CHANGE_MINUTE;
+        if (++tm_time.tm_min == 60) {
+          tm_time.tm_min = 0;
+          time_change_flags |= TIME_CHANGE_HOUR;
+          if (++tm_time.tm_hour == 24) {
+            tm_time.tm_hour = 0;
+            time_change_flags |= TIME_CHANGE_DAY;
+            tm_time.tm_wday = (tm_time.tm_wday + 1) % 7;
+            if (tm_time.tm_wday == 1)             // Week starts on Monday
+              time_change_flags |= TIME_CHANGE_WEEK;
+            tm_time.tm_yday++;
+            if (++tm_time.tm_mday > daysInMonth(tm_time.tm_mon, tm_time.tm_year)) {
+              tm_time.tm_mday = 1;
+              time_change_flags |= TIME_CHANGE_MONTH;
+              if (++tm_time.tm_mon == 12) {
+                tm_time.tm_mon = 0;
+                tm_time.tm_yday = 0;
+                tm_time.tm_year++;
+                time_change_flags |= TIME_CHANGE_YEAR;
+              }
+            }
+          }
+        }
+      }
+    } else {                                      // Time jump or DST change: convert fully
+      const auto tm_time_old = tm_time;
+      resetCalendar();
+      time_change_flags |= TIME_CHANGE_SECOND;      // Even a jump by whole minutes is a new second; timers rely on it
+      if (tm_time_old.tm_min != tm_time.tm_min) {
         time_change_flags |= TIME_CHANGE_MINUTE;
-        if (tm_time.tm_hour != tm_time_new.tm_hour) {
+        if (tm_time_old.tm_hour != tm_time.tm_hour) {
           time_change_flags |= TIME_CHANGE_HOUR;
-          if (tm_time.tm_mday != tm_time_new.tm_mday) {
+          if (tm_time_old.tm_mday != tm_time.tm_mday) {
             time_change_flags |= TIME_CHANGE_DAY;
-            if (tm_time.tm_wday != tm_time_new.tm_wday && tm_time_new.tm_wday == 1)  // Week starts on Monday
+            if (tm_time_old.tm_wday != tm_time.tm_wday && tm_time.tm_wday == 1)  // Week starts on Monday
               time_change_flags |= TIME_CHANGE_WEEK;
-            if (tm_time.tm_mon != tm_time_new.tm_mon) {
+            if (tm_time_old.tm_mon != tm_time.tm_mon) {
               time_change_flags |= TIME_CHANGE_MONTH;
-              if (tm_time.tm_year != tm_time_new.tm_year)
+              if (tm_time_old.tm_year != tm_time.tm_year)
                 time_change_flags |= TIME_CHANGE_YEAR;
             }
           }
         }
       }
     }
-    tm_time = tm_time_new;
   }
+
+#ifdef DS_CAP_SYS_RTCMEM
+  if (newMinute())
+    storeRTCSnapshot();
+#endif // DS_CAP_SYS_RTCMEM
 #endif // DS_CAP_SYS_TIME
 }
 
@@ -2389,6 +3228,10 @@ String System::getCapabilities() {
   ADD_DS_CAP(__STRING(DS_CAP_TIMERS_COUNT_TICK))
 #endif // DS_CAP_TIMERS_COUNT_TICK
 
+#ifdef DS_CAP_TIMERS_COUNT_MS
+  ADD_DS_CAP(__STRING(DS_CAP_TIMERS_COUNT_MS))
+#endif // DS_CAP_TIMERS_COUNT_MS
+
 #ifdef DS_CAP_WEB_TIMERS
   ADD_DS_CAP(__STRING(DS_CAP_WEB_TIMERS))
 #endif // DS_CAP_WEB_TIMERS
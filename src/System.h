@@ -27,6 +27,7 @@
 // DS_CAP_TIMERS_SOLAR      - enable timers from solar events
 // DS_CAP_TIMERS_COUNT_ABS  - enable countdown timers via absolute time
 // DS_CAP_TIMERS_COUNT_TICK - enable countdown timers via ticker
+// DS_CAP_TIMERS_COUNT_MS   - enable countdown timers with millisecond precision via millis()
 // DS_CAP_WEB_TIMERS        - enable timer configuration via web
 
 // System version
@@ -77,9 +78,9 @@
 #define DS_CAP_TIMERS_ABS
 #endif // (DS_CAP_TIMERS_SOLAR || DS_CAP_TIMERS_COUNT_ABS) && !DS_CAP_TIMERS_ABS
 
-#if (defined(DS_CAP_TIMERS_ABS) || defined(DS_CAP_TIMERS_COUNT_TICK)) && !defined(DS_CAP_TIMERS)
+#if (defined(DS_CAP_TIMERS_ABS) || defined(DS_CAP_TIMERS_COUNT_TICK) || defined(DS_CAP_TIMERS_COUNT_MS)) && !defined(DS_CAP_TIMERS)
 #define DS_CAP_TIMERS
-#endif // (DS_CAP_TIMERS_ABS || DS_CAP_TIMERS_COUNT_TICK) && !DS_CAP_TIMERS
+#endif // (DS_CAP_TIMERS_ABS || DS_CAP_TIMERS_COUNT_TICK || DS_CAP_TIMERS_COUNT_MS) && !DS_CAP_TIMERS
 
 #if defined(DS_CAP_TIMERS_ABS) && !defined(DS_CAP_SYS_TIME)
 #warning "Selected timer functionality requires time; enabling"
@@ -99,9 +100,9 @@
 #define TIMED(MSG) "%010lu: " MSG, millis()
 #endif // DS_CAP_SYS_LOG
 
-#ifdef DS_CAP_SYS_RESET
+#if defined(DS_CAP_SYS_RESET) || defined(DS_CAP_SYS_RTCMEM)
 #include <user_interface.h>         // ESP interface
-#endif // DS_CAP_SYS_RESET
+#endif // DS_CAP_SYS_RESET || DS_CAP_SYS_RTCMEM
 
 #ifdef DS_CAP_SYS_FS
 #include <FS.h>                     // File system
@@ -115,14 +116,26 @@
 #include <AceButton.h>              // Button, https://github.com/bxparks/AceButton
 #endif // DS_CAP_BUTTON
 
-#if defined(DS_CAP_TIMERS_ABS) || defined(DS_CAP_WEB_TIMERS)
-#include <forward_list>             // Timer or action list
-#endif // DS_CAP_TIMERS_ABS || DS_CAP_WEB_TIMERS
+#ifdef DS_CAP_TIMERS
+#include <vector>                   // Timer action table
+#endif // DS_CAP_TIMERS
+
+#ifdef DS_CAP_TIMERS_ABS
+#include <utility>                  // Timer queue entry
+#endif // DS_CAP_TIMERS_ABS
 
 #ifdef DS_CAP_TIMERS_COUNT_TICK
 #include <Ticker.h>                 // Periodic events
 #endif // DS_CAP_TIMERS_COUNT_TICK
 
+#ifdef DS_CAP_SYS_RTCMEM
+// RTC memory layout (4 bytes slots). The first 32 slots are overwritten by OTA updates and are left alone
+#define DS_RTCMEM_SLOT_SYS  32                        // First slot of the system snapshot
+#define DS_RTCMEM_SLOTS_SYS 9                         // Number of slots taken by the system snapshot
+#define DS_RTCMEM_SLOT_APP  (DS_RTCMEM_SLOT_SYS + DS_RTCMEM_SLOTS_SYS) // First slot available to the application
+#define DS_RTCMEM_SLOTS     128                       // Total number of slots
+#endif // DS_CAP_SYS_RTCMEM
+
 namespace ds {
 
 #ifdef DS_CAP_SYS_TIME
@@ -149,39 +162,119 @@ namespace ds {
     TIMER_SUNSET,                                     // Timer fires at sunset
     TIMER_COUNTDOWN_ABS,                              // Timer fires at some moment from now, counted via absolute time
     TIMER_COUNTDOWN_TICK,                             // Timer fires at some moment from now, counted via ticker
+    TIMER_COUNTDOWN_MS,                               // Timer fires at some moment from now, counted via millis()
     TIMER_INVALID                                     // Unsupported timer type (must be the last)
   } timer_type_t;
 
-  class Timer {                                       // Generic timer (abstract)
+  class Timer;
+  typedef uint8_t timer_action_t;                     // Timer action identifier (index in the action table)
+  typedef void (*timer_action_handler_t)(const Timer* /* timer */, const int32_t /* arg */); // Timer action handler
 
-    protected:
-      int id;                                         // Timer identifier (optional)
-      timer_type_t type;                              // Timer type
-      String action;                                  // Timer action (short description of what it is supposed to do)
-      bool armed;                                     // True if timer is armed (will fire); false if ignored with no action
-      bool recurrent;                                 // True if timer should be auto-rearmed after firing; false otherwise
-      bool transient;                                 // True if timer should be disposed of after firing
+#define TIMER_ACTION_UNDEFINED 0                      // Action of a timer with no valid action
+#define TIMER_ACTION_MAX       UINT8_MAX              // Maximum number of timer actions
+#define TIMER_ACTION_NAME_MAX  47                     // Maximum length of a timer action name that can be stored in the configuration
+
+  struct TimerAction {                                // Timer action table entry
+    String name;                                      // Action name (short description of what it is supposed to do)
+    timer_action_handler_t handler;                   // Action handler (nullptr = use System::timerHandler)
+    int32_t arg;                                      // Argument passed to the handler
+    bool offered;                                     // True if action is offered for configuration; false if only known to some timers
+  };
+
+#define TIMER_FLAG_ARMED                            1 // Timer is armed (will fire); otherwise ignored with no action
+#define TIMER_FLAG_RECURRENT (TIMER_FLAG_ARMED << 1)  // Timer is auto-rearmed after firing
+#define TIMER_FLAG_TRANSIENT (TIMER_FLAG_RECURRENT << 1) // Timer is disposed of after firing
+#define TIMER_FLAG_SKIP_MISSED (TIMER_FLAG_TRANSIENT << 1) // Missed firings are skipped; otherwise they are run late
+
+#define TIMER_LATENESS_BUCKETS 6                      // Number of timer lateness histogram buckets: <10 ms, <100 ms, <1 s, <10 s, <1 min, 1 min+
+#define TIMER_MISSED_LATENESS  1000                   // Firing late by this much (ms) or more is considered missed
+#ifndef DS_TIMERS_RUN_LATE_MAX
+#define DS_TIMERS_RUN_LATE_MAX 3600                   // Missed firings later than this (s) are skipped whatever the timer policy is
+#endif // !DS_TIMERS_RUN_LATE_MAX
+
+  // Timer is a packed record of 16 bytes with no virtual methods, so that timers can be kept in a fixed table and copied around.
+  // Meaning of the settings depends on the timer type:
+  //   type                | time                       | offset
+  //   TIMER_ABSOLUTE      | seconds from midnight      | (not used)
+  //   TIMER_SUNRISE/SUNSET| today's event (s from 0:00)| offset from the event (-59..+59 min)
+  //   TIMER_COUNTDOWN_ABS | interval (1..86400 s)      | offset from midnight (0..interval-1 s)
+  //   TIMER_COUNTDOWN_MS  | interval (1..INT32_MAX ms) | deadline (millis() value)
+  // Classes derived from Timer only provide constructors and add no data, so they can be stored in the table as Timer
+  class Timer {                                       // Generic timer
 
-      void setType(const timer_type_t /* type */);    // Set timer type
+    protected:
+      int16_t id;                                     // Timer identifier (optional; -1 = none)
+      uint8_t type;                                   // Timer type (timer_type_t)
+      timer_action_t action;                          // Timer action identifier
+      uint8_t flags;                                  // Timer flags (TIMER_FLAG_*)
+      uint8_t dow;                                    // Day of week bitmask (absolute timers)
+      uint16_t reserved;                              // (not used)
+      int32_t time;                                   // Time setting (see above)
+      int32_t offset;                                 // Offset setting (see above)
+
+      void setFlag(const uint8_t /* flag */, const bool /* value */); // Set or clear timer flag
+#ifdef DS_CAP_TIMERS_ABS
+      time_t nextFiringAbsolute(const time_t /* from_time */) const; // Return the first firing time of absolute timer
+#endif // DS_CAP_TIMERS_ABS
+#ifdef DS_CAP_TIMERS_SOLAR
+      time_t nextFiringSolar(const time_t /* from_time */) const; // Return the first firing time of solar timer
+#endif // DS_CAP_TIMERS_SOLAR
+#ifdef DS_CAP_TIMERS_COUNT_ABS
+      time_t nextFiringCountdown(const time_t /* from_time */) const; // Return the first firing time of countdown timer
+#endif // DS_CAP_TIMERS_COUNT_ABS
 
     public:
-      Timer(const timer_type_t /* type */, const String action = "undefined",
+      Timer();                                        // Constructor of a free timer table entry
+      Timer(const timer_type_t /* type */, const String& action = "undefined",
         const bool armed = true, const bool recurrent = true, const bool transient = false, const int id = -1);  // Constructor
-      virtual ~Timer() = 0;                           // Disallow creation of objects of this type
-      virtual int getID() const;                      // Return timer identifier
-      virtual void setID(const int /* new_id */);     // Set timer identifier
-      virtual timer_type_t getType() const;           // Get timer type
-      virtual const String& getAction() const;        // Return timer action
-      virtual void setAction(const String& /* new_action */); // Set timer action
-      virtual bool isArmed() const;                   // Return true if timer is armed
-      virtual void arm();                             // Arm the timer (default)
-      virtual void disarm();                          // Disarm the timer
-      virtual bool isRecurrent() const;               // Return true if timer is recurrent
-      virtual void repeatForever();                   // Make timer repetitive (default)
-      virtual void repeatOnce();                      // Make timer a one-time shot
-      virtual bool isTransient() const;               // Return true if timer is transient (i.e., will be dead after firing)
-      virtual void keep();                            // Keep the timer around (default)
-      virtual void forget();                          // Mark the timer for disposal
+      int getID() const;                              // Return timer identifier
+      void setID(const int /* new_id */);             // Set timer identifier
+      timer_type_t getType() const;                   // Get timer type
+      void setType(const timer_type_t /* type */);    // Set timer type. Setting TIMER_INVALID frees the timer table entry
+      const String& getAction() const;                // Return timer action
+      void setAction(const String& /* new_action */); // Set timer action
+      timer_action_t getActionID() const;             // Return timer action identifier
+      void setActionID(const timer_action_t /* new_action */); // Set timer action identifier
+      bool isArmed() const;                           // Return true if timer is armed
+      void arm();                                     // Arm the timer (default)
+      void disarm();                                  // Disarm the timer
+      bool isRecurrent() const;                       // Return true if timer is recurrent
+      void repeatForever();                           // Make timer repetitive (default)
+      void repeatOnce();                              // Make timer a one-time shot
+      bool isTransient() const;                       // Return true if timer is transient (i.e., will be dead after firing)
+      void keep();                                    // Keep the timer around (default)
+      void forget();                                  // Mark the timer for disposal
+      bool skipsMissed() const;                       // Return true if missed firings are skipped rather than run late
+      void runMissed();                               // Run missed firings late (default)
+      void skipMissed();                              // Skip missed firings
+#ifdef DS_CAP_TIMERS_ABS
+      uint8_t getHour() const;                        // Return hour setting
+      void setHour(const uint8_t /* new_hour */);     // Set hour setting
+      uint8_t getMinute() const;                      // Return minute setting
+      void setMinute(const uint8_t /* new_minute */); // Set minute setting
+      uint8_t getSecond() const;                      // Return second setting
+      void setSecond(const uint8_t /* new_second */); // Set second setting
+      uint8_t getDayOfWeek() const;                   // Get day of week setting
+      void setDayOfWeek(const uint8_t /* new_dow */); // Set day of week setting
+      void enableDayOfWeek(const uint8_t /* new_dow */); // Enable some day(s) of week
+      void disableDayOfWeek(const uint8_t /* new_dow */); // Disable some day(s) of week
+      int32_t getOffset() const;                      // Return offset (solar timer: min from event; countdown timer: s from midnight)
+      void setOffset(const int32_t /* new_offset */); // Set offset (solar timer: min from event; countdown timer: s from midnight)
+      time_t nextFiring(const time_t /* from_time */) const; // Return the first firing time after a given time (0 = never)
+#endif // DS_CAP_TIMERS_ABS
+#ifdef DS_CAP_TIMERS_SOLAR
+      void adjust();                                  // Recalculate alignment to solar times (solar timer)
+#endif // DS_CAP_TIMERS_SOLAR
+#ifdef DS_CAP_TIMERS_COUNT_ABS
+      uint32_t getInterval() const;                   // Return timer interval (s; countdown timer)
+      void setInterval(const uint32_t /* new_interval */); // Set timer interval (s; countdown timer)
+#endif // DS_CAP_TIMERS_COUNT_ABS
+#ifdef DS_CAP_TIMERS_COUNT_MS
+      uint32_t getIntervalMs() const;                 // Return timer interval (ms; millisecond countdown timer)
+      void setIntervalMs(const uint32_t /* new_interval */); // Set timer interval (ms; millisecond countdown timer). Takes effect when rearmed
+      unsigned long getDeadline() const;              // Return next firing time (millis(); millisecond countdown timer)
+      void setDeadline(const unsigned long /* deadline */); // Set next firing time (millis(); millisecond countdown timer)
+#endif // DS_CAP_TIMERS_COUNT_MS
       bool operator==(const Timer& /* timer */) const; // Comparison operator
       bool operator!=(const Timer& /* timer */) const; // Comparison operator
   };
@@ -201,105 +294,68 @@ namespace ds {
 #define TIMER_DOW_ANY       (TIMER_DOW_SUNDAY | TIMER_DOW_MONDAY   | TIMER_DOW_TUESDAY | TIMER_DOW_WEDNESDAY \
                                               | TIMER_DOW_THURSDAY | TIMER_DOW_FRIDAY  | TIMER_DOW_SATURDAY)
 
-  class TimerAbsolute : public virtual Timer {        // Absolute time timer
-
-    protected:
-      struct tm time;                                 // Timer firing details
+#ifndef DS_TIMERS_MAX
+#define DS_TIMERS_MAX 32                              // Capacity of the timer table
+#endif // !DS_TIMERS_MAX
 
+  class TimerAbsolute : public Timer {                // Absolute time timer
     public:
-      TimerAbsolute(const String action = "undefined", const uint8_t hour = 0, const uint8_t minute = 0, const uint8_t second = 0,
+      TimerAbsolute(const String& action = "undefined", const uint8_t hour = 0, const uint8_t minute = 0, const uint8_t second = 0,
         const uint8_t dow = TIMER_DOW_ANY, const bool armed = true, const bool recurrent = true, const bool transient = false,
         const int id = -1);  // Constructor
-      virtual ~TimerAbsolute() {}                     // Destructor
-      virtual uint8_t getHour() const;                // Return hour setting
-      virtual void setHour(const uint8_t /* new_hour */); // Set hour setting
-      virtual uint8_t getMinute() const;              // Return minute setting
-      virtual void setMinute(const uint8_t /* new_minute */); // Set minute setting
-      virtual uint8_t getSecond() const;              // Return second setting
-      virtual void setSecond(const uint8_t /* new_second */); // Set second setting
-      virtual uint8_t getDayOfWeek() const;           // Get day of week setting
-      virtual void setDayOfWeek(const uint8_t /* new_dow */); // Set day of week setting
-      virtual void enableDayOfWeek(const uint8_t /* new_dow */); // Enable some day(s) of week
-      virtual void disableDayOfWeek(const uint8_t /* new_dow */); // Disable some day(s) of week
-      bool operator==(const TimerAbsolute& /* timer */) const; // Comparison operator
-      bool operator!=(const TimerAbsolute& /* timer */) const; // Comparison operator
-      bool operator==(const struct tm& /* _tm */) const; // Time comparison operator
-      bool operator!=(const struct tm& /* _tm */) const; // Time comparison operator
   };
 #endif // DS_CAP_TIMERS_ABS
 
 #ifdef DS_CAP_TIMERS_SOLAR
-  class TimerSolar : public TimerAbsolute {   // Solar event-based timer
-
+  class TimerSolar : public Timer {                   // Solar event-based timer
     public:
-      TimerSolar(const String action = "undefined", const timer_type_t type = TIMER_SUNRISE, const int8_t offset = 0, const uint8_t dow = TIMER_DOW_ANY,
+      TimerSolar(const String& action = "undefined", const timer_type_t type = TIMER_SUNRISE, const int8_t offset = 0, const uint8_t dow = TIMER_DOW_ANY,
         const bool armed = true, const bool recurrent = true, const bool transient = false, const int id = -1);  // Constructor
-      virtual int8_t getOffset() const;               // Return offset in minutes from event
-      virtual void setOffset(const int8_t /* offset */); // Set offset in minutes from event
-      virtual void adjust();                          // Recalculate alignment to solar times
-      bool operator==(const TimerSolar& /* timer */) const; // Comparison operator
-      bool operator!=(const TimerSolar& /* timer */) const; // Comparison operator
   };
 #endif // DS_CAP_TIMERS_SOLAR
 
-#if defined(DS_CAP_TIMERS_COUNT_ABS) || defined(DS_CAP_TIMERS_COUNT_TICK)
-  class TimerCountdown : public virtual Timer {       // Countdown timer
-
-    protected:
-      float interval;                                 // Countdown duration (s)
-
-    public:
-      TimerCountdown(const timer_type_t /* type */, const String action = "undefined", const float interval = 1,
-        const bool armed = true, const bool recurrent = true, const bool transient = false, const int id = -1);  // Constructor
-      virtual ~TimerCountdown() = 0;                  // Disallow creation of objects of this type
-      virtual float getInterval() const;              // Return timer interval (s)
-      virtual void setInterval(const float /* interval */); // Set timer interval (s)
-      bool operator==(const TimerCountdown& /* timer */) const; // Comparison operator
-      bool operator!=(const TimerCountdown& /* timer */) const; // Comparison operator
-  };
-#endif // DS_CAP_TIMERS_COUNT_ABS || DS_CAP_TIMERS_COUNT_TICK
-
 #ifdef DS_CAP_TIMERS_COUNT_ABS
-  class TimerCountdownAbs : public TimerCountdown, public TimerAbsolute {
-
-    protected:
-      time_t getNextTime() const;                     // Return next firing time
-      void setNextTime(const time_t /* new_time */);  // Set next firing time
-
+  class TimerCountdownAbs : public Timer {            // Countdown timer, counting via absolute time
     public:
-      TimerCountdownAbs(const String action = "undefined", const float interval = 1, const uint32_t offset = 0, const uint8_t dow = TIMER_DOW_ANY,
+      TimerCountdownAbs(const String& action = "undefined", const uint32_t interval = 1, const uint32_t offset = 0, const uint8_t dow = TIMER_DOW_ANY,
         const bool armed = true, const bool recurrent = true, const bool transient = false, const int id = -1);  // Constructor
-      ~TimerCountdownAbs() {}                         // Destructor
-      virtual float getInterval() const;              // Return timer interval (s)
-      virtual void setInterval(const float /* interval */); // Set timer interval (s)
-      virtual uint32_t getOffset() const;             // Return timer offset in seconds from midnight
-      virtual void setOffset(const uint32_t /* offset */); // Set timer offset in seconds from midnight
-      virtual void update(const time_t from_time = 0); // Prepare timer for firing. 0 means from current time
-      bool operator==(const TimerCountdownAbs& /* timer */) const; // Comparison operator
-      bool operator!=(const TimerCountdownAbs& /* timer */) const; // Comparison operator
   };
 #endif // DS_CAP_TIMERS_COUNT_ABS
 
 #ifdef DS_CAP_TIMERS_COUNT_TICK
-  class TimerCountdownTick : public TimerCountdown {
+  class TimerCountdownTick : public Timer {           // Countdown timer, counting via ticker. Not kept in the timer table
 
     protected:
+      float interval;                                 // Countdown duration (s)
       Ticker ticker;                                  // Ticker instance
       Ticker::callback_function_t callback;           // Ticker callback
 
     public:
-      TimerCountdownTick(const String action = "undefined", const float interval = 1, Ticker::callback_function_t callback = nullptr,
+      TimerCountdownTick(const String& action = "undefined", const float interval = 1, Ticker::callback_function_t callback = nullptr,
         const bool armed = true, const bool recurrent = true, const bool transient = false, const int id = -1);  // Constructor
-      ~TimerCountdownTick() {}                        // Destructor
-      virtual void arm();                             // Arm the timer (default)
-      virtual void disarm();                          // Disarm the timer
-      virtual void repeatForever();                   // Make timer repetitive (default)
-      virtual void repeatOnce();                      // Make timer a one-time shot
+      float getInterval() const;                      // Return timer interval (s)
+      void setInterval(const float /* interval */);   // Set timer interval (s)
+      void arm();                                     // Arm the timer (default)
+      void disarm();                                  // Disarm the timer
+      void repeatForever();                           // Make timer repetitive (default)
+      void repeatOnce();                              // Make timer a one-time shot
       bool operator==(const TimerCountdownTick& /* timer */) const; // Comparison operator
       bool operator!=(const TimerCountdownTick& /* timer */) const; // Comparison operator
   };
 #endif // DS_CAP_TIMERS_COUNT_TICK
 
+#ifdef DS_CAP_TIMERS_COUNT_MS
+#ifndef DS_TIMERS_MS_MAX
+#define DS_TIMERS_MS_MAX 8                            // Capacity of the millisecond timer table
+#endif // !DS_TIMERS_MS_MAX
+
+  class TimerCountdownMs : public Timer {             // Countdown timer, counting via millis(). Arming starts the countdown
+    public:
+      TimerCountdownMs(const String& action = "undefined", const uint32_t interval = 1, const bool armed = true, const bool recurrent = true,
+        const bool transient = false, const int id = -1);  // Constructor
+  };
+#endif // DS_CAP_TIMERS_COUNT_MS
+
   // System class is just a collection of system-wide routines, so all of them are made static on purpose
   class System {
 
@@ -350,6 +406,14 @@ namespace ds {
 #ifdef DS_CAP_SYS_RTCMEM
       static bool getRTCMem(uint32_t* /* result */, const uint8_t idx = 0, const uint8_t num = 1); // Read 'num' 4 bytes slots from RTC memory offset 'idx' into 'result'
       static bool setRTCMem(const uint32_t* /* source */, const uint8_t idx = 0, const uint8_t num = 1); // Store 'num' 4 bytes slots into RTC memory offset 'idx' from 'source'
+      static bool isWarmStart();                      // Return true if the system state was recovered from RTC memory after a warm reset
+      static bool storeRTCSnapshot();                 // Store system state into RTC memory, to be recovered after a warm reset. Returns true on success
+
+    protected:
+      static bool warm_start;                         // System state was recovered from RTC memory
+      static bool loadRTCSnapshot();                  // Recover system state from RTC memory after a warm reset. Returns true on success
+
+    public:
 #endif // DS_CAP_SYS_RTCMEM
 
 #ifdef DS_CAP_SYS_TIME
@@ -357,6 +421,9 @@ namespace ds {
       static time_sync_t time_sync_status;            // Time synchronization status
       static time_t time_sync_time;                   // Last time the time was synchronized
       static uint8_t time_change_flags;               // Time change flags
+      static unsigned long time_millis;               // millis() when the current second was first seen
+      static time_t calendar_end;                     // Time from which tm_time cannot be advanced arithmetically (next possible DST change)
+      static void resetCalendar();                    // Convert current time into tm_time and find the next DST change
       static void timeSyncHandler();                  // Time sync event handler
 
     public:
@@ -390,6 +457,7 @@ namespace ds {
 
 #ifdef DS_CAP_SYS_FS
       static fs::FS& fs;                              // File system control object
+      static const char *sys_folder_name;             // Folder where settings are stored
 #endif // DS_CAP_SYS_FS
 
 #ifdef DS_CAP_SYS_NETWORK
@@ -445,9 +513,6 @@ namespace ds {
       static void pushHTMLFooter();                   // Add standard footer to the web page
       static void (*registerWebPages)();              // Hook for registering user-supplied pages
       static void sendWebPage();                      // Send a web page
-#ifdef DS_CAP_WEB_TIMERS
-      static std::forward_list<String> timer_actions; // List of timer actions
-#endif // DS_CAP_WEB_TIMERS
 #endif // DS_CAP_WEBSERVER
 
 #ifdef DS_CAP_BUTTON
@@ -460,19 +525,63 @@ namespace ds {
       static void (*onButtonPress)(ace_button::AceButton* /* button */, uint8_t /* event_type */, uint8_t /* button_state */); // Hook to be called when button is operated
 #endif // DS_CAP_BUTTON
 
+#ifdef DS_CAP_TIMERS
+    protected:
+      static std::vector<TimerAction> timer_actions;  // Timer action table, indexed by action identifier
+      static int32_t timer_lateness;                  // How late the timer being fired is (ms)
+      static uint32_t timer_lateness_hist[TIMER_LATENESS_BUCKETS]; // Number of timer firings by lateness
+      static uint32_t timer_missed;                   // Number of missed timer firings
+      static uint32_t timer_skipped;                  // Number of missed timer firings that were skipped
+      static bool checkTimerLateness(const Timer* /* timer */, const int32_t /* lateness */); // Account for timer firing lateness (ms). Returns true if the action is to be run
+      static bool isTimerActionUsed(const timer_action_t /* id */); // Return true if some timer in the system tables refers to an action
+
+    public:
+      static timer_action_t addTimerAction(const String& /* name */, timer_action_handler_t handler = nullptr, const int32_t arg = 0); // Offer timer action for configuration. Returns its identifier
+      static void removeTimerAction(const String& /* name */); // Withdraw timer action from configuration (timers using it keep the identifier)
+      static timer_action_t getTimerActionID(const String& /* name */); // Return timer action identifier, registering the name if unknown
+      static const TimerAction& getTimerAction(const timer_action_t /* id */); // Return timer action by identifier
+      static bool runTimerAction(const Timer* /* timer */); // Call timer action handler. Returns false if action has no handler
+      static void (*timerHandler)(const Timer* /* timer */); // Timer handler (called for actions with no handler)
+      static int32_t getTimerLateness();              // Return how late the timer being fired is (ms)
+      static String getTimerStats();                  // Return timer lateness statistics in human-readable form
+#endif // DS_CAP_TIMERS
+
 #ifdef DS_CAP_TIMERS_ABS
+    protected:
+      static std::pair<time_t, Timer *> timer_queue[DS_TIMERS_MAX]; // Armed timers keyed by next firing time (min-heap)
+      static uint16_t timer_queue_size;               // Number of timers in the queue
+      static bool timer_queue_valid;                  // False if timer queue needs rebuilding
+      static void buildTimerQueue(const time_t /* from_time */); // Rebuild timer queue for firings after a given time
+      static void queueTimer(Timer* /* timer */, const time_t /* from_time */); // Add timer to the queue for its first firing after a given time
+
     public:
       static bool abs_timers_active;                  // True if absolute or solar timers should be served
-      static std::forward_list<TimerAbsolute *> timers; // List of timers
-      static TimerAbsolute* getTimerAbsByID(const int /* id */); // Return absolute timer with a matching ID
-      static void (*timerHandler)(const TimerAbsolute* /* timer */); // Timer handler
+      static Timer timers[DS_TIMERS_MAX];             // Timer table. Free entries have TIMER_INVALID type
+      static Timer* getTimerByID(const int /* id */); // Return timer with a matching ID (nullptr = not found)
+      static Timer* addTimer(const Timer& /* timer */); // Add timer, replacing the one with the same ID, if any. Returns timer table entry (nullptr = table full)
+      static bool removeTimer(const int /* id */);    // Remove timer with a matching ID. Returns true if timer was found
+      static uint16_t getTimerCount();                // Return number of timers in the table
+      static void scheduleTimers();                   // Request timer queue rebuild. To be called after changing timers
+      static time_t getNextTimerTime();               // Return next timer firing time (0 = none or unknown yet)
 #endif // DS_CAP_TIMERS_ABS
 
-#ifdef DS_CAP_TIMERS_SOLAR
+#ifdef DS_CAP_TIMERS_COUNT_MS
     protected:
-      static uint16_t getSolarEvent(const timer_type_t /* ev_type */); // Return solar event time
+      static unsigned long ms_timer_next;             // Earliest deadline of millisecond timers (millis())
+      static bool ms_timer_next_valid;                // False if the earliest deadline needs recalculation
+      static void updateMsTimers();                   // Fire millisecond timers that are due
+
+    public:
+      static Timer ms_timers[DS_TIMERS_MS_MAX];       // Millisecond timer table. Free entries have TIMER_INVALID type
+      static Timer* getMsTimerByID(const int /* id */); // Return millisecond timer with a matching ID (nullptr = not found)
+      static Timer* addMsTimer(const TimerCountdownMs& /* timer */); // Add millisecond timer, replacing the one with the same ID, if any. Returns timer table entry (nullptr = table full)
+      static bool removeMsTimer(const int /* id */);  // Remove millisecond timer with a matching ID. Returns true if timer was found
+      static void scheduleMsTimers();                 // Request earliest deadline recalculation. To be called after changing millisecond timers
+#endif // DS_CAP_TIMERS_COUNT_MS
 
+#ifdef DS_CAP_TIMERS_SOLAR
     public:
+      static time_t getSolarEvent(const timer_type_t /* ev_type */, const struct tm& /* day */); // Return solar event time on a given day
       static uint16_t getSunrise();                  // Return sunrise time (in minutes from midnight)
       static uint16_t getSunset();                   // Return sunset time (in minutes from midnight)
 #endif // DS_CAP_TIMERS_SOLAR
@@ -481,6 +590,10 @@ namespace ds {
     protected:
 #ifdef DS_CAP_SYS_FS
       static String timers_cfg_name;                 // Full path to the timers configuration file
+      static bool loadTimers();                      // Load timer configuration. Returns true on success
+      static bool loadTimersV1(const String& /* cfg_name */); // Load timer configuration in the first (text) format. Returns true on success
+      static bool storeTimers();                     // Store timer configuration. Returns true on success
+      static bool storeTimer(const int /* id */);    // Store configuration record of a timer (0 = global settings only). Returns true on success
 #endif // DS_CAP_SYS_FS
       static void timersJS(String& /* str */);       // Generate timer configuration as JavaScript code
 #endif // DS_CAP_WEB_TIMERS
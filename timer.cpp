@@ -5,28 +5,76 @@
 
 #include "MySystem.h"                      // System-level definitions
 #include "BulbManager.h"                   // Bulb manager
+#include "Sequencer.h"                     // Macro sequencer
 
 using namespace ds;
 
-// Timer handler
-void myTimerHandler(const TimerAbsolute* timer) {
-
+// Return log message reason for a fired timer
+static String timerReason(const Timer* timer) {
   String reason("Timer \"");
   reason += timer->getAction();
   reason += "\" fired";
+  return reason;
+}
+
+// Timer action: power event (argument is BulbManager::event_t)
+static void timerEvent(const Timer* timer, const int32_t event) {
+  bulb_manager.processEvent((BulbManager::event_t)event, timerReason(timer));
+}
+
+// Timer action: brightness (argument is %)
+static void timerBright(const Timer* timer, const int32_t bright) {
+  System::appLogWriteLn(timerReason(timer) + "; adjusting brightness", true);
+  bulb_manager.setLight(YL_PROP_BRIGHT, bright);
+}
+
+// Timer action: color temperature (argument is K)
+static void timerCT(const Timer* timer, const int32_t ct) {
+  System::appLogWriteLn(timerReason(timer) + "; adjusting color temperature", true);
+  bulb_manager.setLight(YL_PROP_CT, ct);
+}
+
+// Timer action: delayed off (argument is min)
+static void timerOffIn(const Timer* timer, const int32_t minutes) {
+  bulb_manager.delayOff(minutes, timerReason(timer));
+}
 
-  if (timer->getAction() == "light on") {
-    bulb_manager.processEvent(BulbManager::EVENT_ON, reason);
-  }
-  else
-  if (timer->getAction() == "light off") {
-    bulb_manager.processEvent(BulbManager::EVENT_OFF, reason);
-  }
-  else
-  if (timer->getAction() == "light toggle") {
-    bulb_manager.processEvent(BulbManager::EVENT_FLIP, reason);
-  }
-}
-
-// Install handler
-void (*System::timerHandler)(const TimerAbsolute*) = myTimerHandler;
+// Timer action: long transition (argument is min; positive to wake up, negative to fade out)
+static void timerRamp(const Timer* timer, const int32_t minutes) {
+  System::appLogWriteLn(timerReason(timer) + (minutes > 0 ? "; lights are ramping up" : "; lights are fading out"), true);
+  bulb_manager.startRamp(abs(minutes), minutes > 0);
+}
+
+// Timer action: restore snapshot (argument is the name prefix length)
+void timerRestore(const Timer* timer, const int32_t prefix) {
+  bulb_manager.restoreSnapshot(timer->getAction().substring(prefix), timerReason(timer));
+}
+
+// Timer action: run macro (argument is the name prefix length)
+void timerMacro(const Timer* timer, const int32_t prefix) {
+  sequencer.start(timer->getAction().substring(prefix), timerReason(timer));
+}
+
+// Timer action: activate scene (argument is the name prefix length)
+void timerScene(const Timer* timer, const int32_t prefix) {
+  bulb_manager.processEvent(BulbManager::EVENT_SCENE, timerReason(timer), timer->getAction().substring(prefix));
+}
+
+// Register fixed timer actions. Actions for snapshots, scenes and macros are registered by their owners
+void registerTimerActions() {
+  System::addTimerAction(F("light on"),             timerEvent,  BulbManager::EVENT_ON);
+  System::addTimerAction(F("light off"),            timerEvent,  BulbManager::EVENT_OFF);
+  System::addTimerAction(F("light toggle"),         timerEvent,  BulbManager::EVENT_FLIP);
+  System::addTimerAction(F("light 100%"),           timerBright, 100);
+  System::addTimerAction(F("light 50%"),            timerBright, 50);
+  System::addTimerAction(F("light 10%"),            timerBright, 10);
+  System::addTimerAction(F("light warm white"),     timerCT,     2700);
+  System::addTimerAction(F("light cold white"),     timerCT,     6500);
+  System::addTimerAction(F("light wake-up 15 min"), timerRamp,   15);
+  System::addTimerAction(F("light wake-up 30 min"), timerRamp,   30);
+  System::addTimerAction(F("light fade out 15 min"), timerRamp,  -15);
+  System::addTimerAction(F("light fade out 30 min"), timerRamp,  -30);
+  System::addTimerAction(F("light off in 15 min"),  timerOffIn,  15);
+  System::addTimerAction(F("light off in 30 min"),  timerOffIn,  30);
+  System::addTimerAction(F("light off in 60 min"),  timerOffIn,  60);
+}
@@ -0,0 +1,21 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Message checker: offline Wi-Fi for a Linux host
+ * (c) DNS 2021
+ */
+
+#ifndef ESP8266WIFI_H
+#define ESP8266WIFI_H
+
+#include <WiFiUdp.h>                       // WiFiClient, WiFiUDP
+
+// Wi-Fi interface which is never connected
+class ESP8266WiFiClass {
+
+  public:
+
+    IPAddress localIP() { return IPAddress(); }
+};
+
+extern ESP8266WiFiClass WiFi;              // Wi-Fi interface
+
+#endif // ESP8266WIFI_H
@@ -0,0 +1,43 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Message checker: offline TCP client for a Linux host
+ * (c) DNS 2021
+ */
+
+#ifndef WIFICLIENT_H
+#define WIFICLIENT_H
+
+#include <Arduino.h>
+
+// IPv4 address
+class IPAddress {
+
+  protected:
+
+    uint32_t addr;                         // Address in network byte order
+
+  public:
+
+    IPAddress(const uint32_t addr = 0) : addr(addr) {}
+    IPAddress(const uint8_t a, const uint8_t b, const uint8_t c, const uint8_t d) : addr(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+    operator uint32_t() const { return addr; }
+    bool fromString(const String& s) { unsigned int a, b, c, d; return sscanf(s.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) == 4 && (*this = IPAddress(a, b, c, d), true); }
+    String toString() const { char s[16]; snprintf(s, sizeof(s), "%u.%u.%u.%u", addr & 0xff, addr >> 8 & 0xff, addr >> 16 & 0xff, addr >> 24); return s; }
+};
+
+// TCP client which never connects
+class WiFiClient {
+
+  public:
+
+    void setTimeout(const unsigned long) {}
+    int connect(const IPAddress&, const uint16_t) { return 0; }
+    bool connected() { return false; }
+    void setNoDelay(const bool) {}
+    size_t write(const uint8_t *, const size_t) { return 0; }
+    size_t print(const String&) { return 0; }
+    int available() { return 0; }
+    int read() { return -1; }
+    void stop() {}
+};
+
+#endif // WIFICLIENT_H
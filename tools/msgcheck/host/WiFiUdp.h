@@ -0,0 +1,26 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Message checker: offline UDP socket for a Linux host
+ * (c) DNS 2021
+ */
+
+#ifndef WIFIUDP_H
+#define WIFIUDP_H
+
+#include <WiFiClient.h>                    // IPAddress
+
+// UDP socket which never receives anything
+class WiFiUDP {
+
+  public:
+
+    uint8_t begin(const uint16_t) { return 1; }
+    void stop() {}
+    int beginPacketMulticast(const IPAddress&, const uint16_t, const IPAddress&, const int) { return 1; }
+    size_t write(const char *, const size_t len) { return len; }
+    int endPacket() { return 1; }
+    uint16_t localPort() { return 0; }
+    int parsePacket() { return 0; }
+    int read(char *, const size_t) { return 0; }
+};
+
+#endif // WIFIUDP_H
@@ -0,0 +1,72 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Message checker: verifies bulb command messages composed by the switch on a Linux host
+ * (c) DNS 2021
+ *
+ * Usage: msgcheck [-v]
+ *   -v           print every message checked
+ *
+ * Exit code is 1 if any message differs from what the bulbs expect
+ */
+
+#include <unistd.h>                        // getopt()
+#include <ESP8266WiFi.h>                   // Wi-Fi interface
+#include "../../YeelightDS.h"              // Yeelight support
+
+using namespace ds;
+
+Print Serial(nullptr);                     // Console is not used
+ESP8266WiFiClass WiFi;                     // Wi-Fi interface (offline)
+static bool verbose = false;               // Print every message checked
+static unsigned int failures = 0;          // Number of failed checks
+
+// Milliseconds since start. Messages do not depend on time
+unsigned long millis() {
+  return 0;
+}
+
+// Does nothing
+void delay(unsigned long) {
+}
+
+// Compare a composed message with the expected one
+static void check(const char *what, const String& actual, const char *expected) {
+  const auto ok = actual == expected;
+  if (!ok) {
+    failures++;
+    printf("FAILED %s:\n  got      %s\n  expected %s\n", what, actual.c_str(), expected);
+  } else
+  if (verbose)
+    printf("ok     %s: %s\n", what, actual.c_str());
+}
+
+// Program entry point
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "v")) != -1)
+    switch (opt) {
+      case 'v': verbose = true;                      break;
+      default:
+        fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
+        return 2;
+    }
+
+  // Transitions. Bulbs reject smooth transitions shorter than 30 ms
+  check("sudden transition", YBulb::transition(0), ",\"sudden\",0");
+  check("smooth transition", YBulb::transition(500), ",\"smooth\",500");
+  check("shortest transition", YBulb::transition(10), ",\"smooth\",30");
+
+  // Color flows. The count must cover every flow step, or the bulb stops early
+  check("fade out flow", YBulb::ramp(600000, 1, 4000, YL_FLOW_OFF),
+    "1,2,\"600000,2,4000,1\"");
+  check("wake-up flow", YBulb::ramp(900000, 100, 2700, YL_FLOW_STAY, true),
+    "2,1,\"50,2,2700,1,900000,2,2700,100\"");
+  check("shortest flow step", YBulb::ramp(10, 0, 2700),
+    "1,1,\"50,2,2700,1\"");
+  check("wake-up start_cf", YBulb::message(YL_METHOD_START_CF, YBulb::ramp(1800000, 80, 3000, YL_FLOW_STAY, true)),
+    "{\"id\":1,\"method\":\"start_cf\",\"params\":[2,1,\"50,2,3000,1,1800000,2,3000,80\"]}\r\n");
+  check("wake-up set_scene", YBulb::message(YL_METHOD_SET_SCENE, String(F("\"cf\",")) + YBulb::ramp(900000, 100, 4000, YL_FLOW_STAY, true)),
+    "{\"id\":1,\"method\":\"set_scene\",\"params\":[\"cf\",2,1,\"50,2,4000,1,900000,2,4000,100\"]}\r\n");
+
+  printf("%u failure(s)\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+// DS System configuration for the timer simulator
+// (c) DNS 2021
+
+#ifndef _DS_SYSTEM_H_
+
+#include <time.h>                         // time_t
+
+extern time_t sim_time;                   // Simulated clock (see timersim.cpp)
+#define DS_TIME_SOURCE() sim_time         // Make the system read the simulated clock
+
+// Location defaults match the ones in MySystem.h. Override with CPPFLAGS (e.g., -DDS_LATITUDE=60.2)
+#ifndef DS_TIMEZONE
+#define DS_TIMEZONE  TZ_Europe_Paris
+#endif // !DS_TIMEZONE
+#ifndef DS_LATITUDE
+#define DS_LATITUDE  48.8584
+#endif // !DS_LATITUDE
+#ifndef DS_LONGITUDE
+#define DS_LONGITUDE 2.2945
+#endif // !DS_LONGITUDE
+
+// Large timer table for throughput measurement (make bench loads 100 copies of the timer set)
+#ifndef DS_TIMERS_MAX
+#define DS_TIMERS_MAX 1024
+#endif // !DS_TIMERS_MAX
+
+// Only the timer engine is simulated
+#define DS_CAP_SYS_LOG           // Enable syslog
+#define DS_CAP_SYS_TIME          // Enable system time
+#define DS_CAP_TIMERS_ABS        // Enable timers from absolute time
+#define DS_CAP_TIMERS_SOLAR      // Enable timers from solar events
+#define DS_CAP_TIMERS_COUNT_ABS  // Enable countdown timers via absolute time
+
+#include "../../src/System.h"    // DS-System global definitions
+
+#endif // _DS_SYSTEM_H_
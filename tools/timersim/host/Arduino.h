@@ -0,0 +1,140 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Minimal Arduino core for a Linux host, shared by the host-side tools
+ * (c) DNS 2021
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <string>                          // String storage
+
+// Program memory is ordinary memory on a host
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define F(s) FPSTR(PSTR(s))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+
+#ifndef __STRING
+#define __STRING(x) #x
+#endif // !__STRING
+#ifndef __XSTRING
+#define __XSTRING(x) __STRING(x)
+#endif // !__XSTRING
+
+class __FlashStringHelper;
+
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : (x) > (hi) ? (hi) : (x))
+
+unsigned long millis();                    // Milliseconds since start (simulated clock)
+void delay(unsigned long);                 // Does nothing
+inline unsigned long micros() { return millis() * 1000UL; }  // Microseconds since start, at millisecond resolution
+inline void yield() {}                     // Nothing runs in the background on a host
+
+// Arduino-compatible string
+class String {
+
+  protected:
+
+    std::string str;                       // Contents
+
+  public:
+
+    String(const char *s = "") : str(s ? s : "") {}
+    String(const __FlashStringHelper *s) : str(reinterpret_cast<const char *>(s)) {}
+    explicit String(const char c) : str(1, c) {}
+    explicit String(const int n) : str(std::to_string(n)) {}
+    explicit String(const unsigned int n) : str(std::to_string(n)) {}
+    explicit String(const long n) : str(std::to_string(n)) {}
+    explicit String(const unsigned long n) : str(std::to_string(n)) {}
+    explicit String(const long long n) : str(std::to_string(n)) {}
+
+    unsigned int length() const { return str.length(); }
+    bool isEmpty() const { return str.empty(); }
+    const char *c_str() const { return str.c_str(); }
+    void reserve(const unsigned int size) { str.reserve(size); }
+    char operator[](const unsigned int i) const { return i < str.length() ? str[i] : 0; }
+    char charAt(const unsigned int i) const { return (*this)[i]; }
+
+    String& operator+=(const String& s) { str += s.str; return *this; }
+    String& operator+=(const char *s) { str += s; return *this; }
+    String& operator+=(char *s) { str += s; return *this; }
+    String& operator+=(const __FlashStringHelper *s) { str += reinterpret_cast<const char *>(s); return *this; }
+    String& operator+=(const char c) { str += c; return *this; }
+    template <typename T> String& operator+=(const T n) { str += std::to_string(n); return *this; }
+    bool concat(const String& s) { *this += s; return true; }
+    bool concat(const char *s, const unsigned int len) { str.append(s, len); return true; }
+
+    friend String operator+(const String& a, const String& b) { String s(a); s += b; return s; }
+    friend String operator+(const String& a, const char *b) { String s(a); s += b; return s; }
+    friend String operator+(const String& a, const __FlashStringHelper *b) { String s(a); s += b; return s; }
+    friend String operator+(const String& a, const char b) { String s(a); s += b; return s; }
+
+    bool operator==(const String& s) const { return str == s.str; }
+    bool operator==(const char *s) const { return str == s; }
+    bool operator!=(const String& s) const { return str != s.str; }
+    bool operator!=(const char *s) const { return str != s; }
+    bool operator<(const String& s) const { return str < s.str; }
+    bool equals(const String& s) const { return str == s.str; }
+    bool startsWith(const String& s) const { return str.compare(0, s.str.length(), s.str) == 0; }
+    bool endsWith(const String& s) const { return str.length() >= s.str.length() && str.compare(str.length() - s.str.length(), s.str.length(), s.str) == 0; }
+
+    int indexOf(const char c, const unsigned int from = 0) const { const auto i = str.find(c, from); return i == std::string::npos ? -1 : i; }
+    int indexOf(const String& s, const unsigned int from = 0) const { const auto i = str.find(s.str, from); return i == std::string::npos ? -1 : i; }
+    String substring(const unsigned int from) const { return from < str.length() ? str.substr(from).c_str() : ""; }
+    String substring(const unsigned int from, const unsigned int to) const { return from < to && from < str.length() ? str.substr(from, to - from).c_str() : ""; }
+    long toInt() const { return atol(str.c_str()); }
+    void remove(const unsigned int from, const unsigned int count = UINT_MAX) { if (from < str.length()) str.erase(from, count); }
+    void trim() { const auto b = str.find_first_not_of(" \t\r\n"); str = b == std::string::npos ? "" : str.substr(b, str.find_last_not_of(" \t\r\n") - b + 1); }
+    void replace(const String& from, const String& to) { for (size_t i = 0; !from.isEmpty() && (i = str.find(from.str, i)) != std::string::npos; i += to.length()) str.replace(i, from.length(), to.str); }
+};
+
+// Character output
+class Print {
+
+  protected:
+
+    FILE *stream;                          // Host stream (nullptr = discard output)
+
+  public:
+
+    Print(FILE *stream = stdout) : stream(stream) {}
+    void setStream(FILE *new_stream) { stream = new_stream; }
+    size_t write(const uint8_t c) { return stream ? fputc(c, stream) != EOF : 1; }
+    size_t printf(const char *format, ...) __attribute__ ((format (printf, 2, 3))) {
+      if (!stream)
+        return 0;
+      va_list args;
+      va_start(args, format);
+      const auto ret = vfprintf(stream, format, args);
+      va_end(args);
+      return ret < 0 ? 0 : ret;
+    }
+    size_t print(const char *s) { return stream ? fputs(s, stream), strlen(s) : 0; }
+    size_t print(const String& s) { return print(s.c_str()); }
+    size_t print(const __FlashStringHelper *s) { return print(reinterpret_cast<const char *>(s)); }
+    size_t print(const long n) { return printf("%ld", n); }
+    size_t print(const unsigned long n) { return printf("%lu", n); }
+    size_t print(const int n) { return printf("%d", n); }
+    size_t print(const unsigned int n) { return printf("%u", n); }
+    template <typename T> size_t println(const T s) { return print(s) + print("\n"); }
+    size_t println() { return print("\n"); }
+};
+
+extern Print Serial;                       // Console
+
+#endif // ARDUINO_H
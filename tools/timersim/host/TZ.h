@@ -0,0 +1,24 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Timer simulator: timezone definitions for a Linux host
+ * (c) DNS 2021
+ */
+
+#ifndef TZ_H
+#define TZ_H
+
+#include <stdlib.h>                        // setenv()
+#include <time.h>                          // tzset()
+
+// Only the zones referred to by the simulator are listed. Strings are the same as in ESP8266 core
+#define TZ_Etc_UTC          PSTR("UTC0")
+#define TZ_Europe_Paris     PSTR("CET-1CEST,M3.5.0,M10.5.0/3")
+#define TZ_Europe_London    PSTR("GMT0BST,M3.5.0/1,M10.5.0")
+#define TZ_America_New_York PSTR("EST5EDT,M3.2.0,M11.1.0")
+
+// Set timezone
+inline void setTZ(const char *tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+#endif // TZ_H
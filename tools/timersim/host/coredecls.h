@@ -0,0 +1,12 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Timer simulator: ESP8266 core declarations for a Linux host
+ * (c) DNS 2021
+ */
+
+#ifndef CORE_DECLS_H
+#define CORE_DECLS_H
+
+// Time sync callback. Simulated clock is always in sync, so the callback is never called
+inline void settimeofday_cb(void (*)()) {}
+
+#endif // CORE_DECLS_H
@@ -0,0 +1,244 @@
+/* Yeelight Smart Switch App for ESP8266
+ * Timer simulator: replays a year of timer schedules on a Linux host with a simulated clock
+ * (c) DNS 2021
+ *
+ * Usage: timersim [-y year] [-z timezone] [-n copies] [-f] [-q] [-v]
+ *   -y year      year to replay (default: current year)
+ *   -z timezone  POSIX timezone string (default: DS_TIMEZONE, see SimSystem.h)
+ *   -n copies    number of copies of the timer set to load, for throughput measurement (default: 1)
+ *   -f           fast-forward idle periods to the next timer due, instead of stepping every second
+ *   -q           do not print the firing log
+ *   -v           print system log
+ *
+ * The clock is stepped one second per System::update() call, just like on the device where update() is called from loop().
+ * Clock and solar timers are checked to fire exactly once on every enabled day; countdown timers are checked to fire once
+ * per interval counted from midnight. Exit code is 1 if any missed or double firing is detected
+ */
+
+#include <unistd.h>                        // getopt()
+#include <chrono>                          // Wall clock
+#include <vector>                          // Timer statistics
+#include <TZ.h>                            // setTZ()
+#include "SimSystem.h"                     // System-level definitions
+
+using namespace ds;
+
+time_t sim_time = 0;                       // Simulated clock
+static time_t sim_start = 0;               // Simulation start time
+static bool sim_log = true;                // Print firing log
+
+Print Serial(nullptr);                     // System log is discarded by default
+
+// Milliseconds since simulation start, following the system clock as last seen by System::update().
+//// On the device, timers are processed within a few milliseconds after the second changes; here, the simulated clock is already
+//// one second ahead by then, which would make every firing look missed
+unsigned long millis() {
+  return (System::getTime() - sim_start) * 1000UL;
+}
+
+// Does nothing; simulated time only advances in the main loop
+void delay(unsigned long) {
+}
+
+// Simulated timer definition
+struct SimTimer {
+  timer_type_t type;                       // Timer type
+  uint8_t hour;                            // Hour (clock timers)
+  uint8_t minute;                          // Minute (clock timers)
+  int32_t offset;                          // Offset (min for solar timers; s for countdown timers)
+  uint32_t interval;                       // Interval (s; countdown timers)
+  uint8_t dow;                             // Days of week
+  const char *action;                      // Action
+};
+
+// Timer set, similar to what a user would configure on the /timers page.
+// 2:30 falls into the spring DST gap and is repeated in the autumn in Europe and in the USA
+static const SimTimer SIM_TIMERS[] = {
+  {TIMER_ABSOLUTE,      7, 0,   0,    0, TIMER_DOW_ANY & ~(TIMER_DOW_SATURDAY | TIMER_DOW_SUNDAY), "light wake-up 15 min"},
+  {TIMER_ABSOLUTE,      9, 0,   0,    0, TIMER_DOW_SATURDAY | TIMER_DOW_SUNDAY,                     "light on"},
+  {TIMER_SUNRISE,       0, 0,  15,    0, TIMER_DOW_ANY,                                             "light off"},
+  {TIMER_SUNSET,        0, 0, -15,    0, TIMER_DOW_ANY,                                             "light on"},
+  {TIMER_ABSOLUTE,     23, 30,  0,    0, TIMER_DOW_ANY,                                             "light off"},
+  {TIMER_ABSOLUTE,      2, 30,  0,    0, TIMER_DOW_ANY,                                             "light toggle"},
+  {TIMER_COUNTDOWN_ABS, 0, 0, 600, 5400, TIMER_DOW_ANY,                                             "light 50%"}
+};
+static const uint8_t SIM_TIMERS_NUM = sizeof(SIM_TIMERS) / sizeof(SIM_TIMERS[0]);
+
+// Firing statistics of a timer
+struct SimStats {
+  std::vector<uint8_t> fires;              // Number of firings per day of year
+};
+static std::vector<SimStats> sim_stats;    // Statistics per timer ID
+
+// Return human-readable description of a simulated timer
+static String describe(const SimTimer& sim_timer) {
+  char str[32];
+  switch (sim_timer.type) {
+    case TIMER_SUNRISE:
+    case TIMER_SUNSET:
+      snprintf(str, sizeof(str), "%s%+d", sim_timer.type == TIMER_SUNRISE ? "sunrise" : "sunset", sim_timer.offset);
+      break;
+    case TIMER_COUNTDOWN_ABS:
+      snprintf(str, sizeof(str), "every %u min", sim_timer.interval / 60);
+      break;
+    default:
+      snprintf(str, sizeof(str), "%02u:%02u", sim_timer.hour, sim_timer.minute);
+  }
+  return str;
+}
+
+// Timer action: log and account for firing
+//// System time is used rather than the simulated clock, as the latter is already one second ahead when timers are processed
+static void simFire(const Timer* timer, const int32_t) {
+  const auto id = timer->getID();
+  const auto& sim_timer = SIM_TIMERS[(id - 1) % SIM_TIMERS_NUM];
+  auto& stats = sim_stats[id];
+  const auto now = System::getTime();
+  struct tm tm_now;
+  localtime_r(&now, &tm_now);
+
+  if (stats.fires[tm_now.tm_yday] < UINT8_MAX)
+    stats.fires[tm_now.tm_yday]++;
+
+  if (sim_log) {
+    char time_str[32];
+    strftime(time_str, sizeof(time_str), "%Y/%m/%d %H:%M:%S %Z", &tm_now);
+    printf("%s  #%-3d %-14s %s\n", time_str, id, describe(sim_timer).c_str(), timer->getAction().c_str());
+  }
+}
+
+// Create a system timer from a simulated timer definition
+static Timer createTimer(const SimTimer& sim_timer, const int id) {
+  switch (sim_timer.type) {
+    case TIMER_SUNRISE:
+    case TIMER_SUNSET:
+      return TimerSolar(sim_timer.action, sim_timer.type, sim_timer.offset, sim_timer.dow, true, true, false, id);
+    case TIMER_COUNTDOWN_ABS:
+      return TimerCountdownAbs(sim_timer.action, sim_timer.interval, sim_timer.offset, sim_timer.dow, true, true, false, id);
+    default:
+      return TimerAbsolute(sim_timer.action, sim_timer.hour, sim_timer.minute, 0, sim_timer.dow, true, true, false, id);
+  }
+}
+
+// Print statistics and return the number of anomalies detected
+static uint32_t report(const uint16_t copies, const uint16_t days) {
+  uint32_t fires_total = 0, anomalies_total = 0;
+
+  if (sim_log)
+    printf("\n  #  Timer          Fires Missed Double Action\n");
+  for (int id = 1; id <= copies * SIM_TIMERS_NUM; id++) {
+    const auto& sim_timer = SIM_TIMERS[(id - 1) % SIM_TIMERS_NUM];
+    const auto& stats = sim_stats[id];
+    uint32_t fires = 0, missed = 0, doubles = 0;
+    for (uint16_t day = 0; day < days; day++) {
+      fires += stats.fires[day];
+
+      // Clock and solar timers must fire once on each enabled day; countdown timers once per interval since midnight
+      struct tm tm_day = {};
+      tm_day.tm_year = localtime(&sim_start)->tm_year;
+      tm_day.tm_mday = day + 1;
+      tm_day.tm_isdst = -1;
+      const auto midnight = mktime(&tm_day);
+      const auto dow_ok = sim_timer.dow & (1 << tm_day.tm_wday);
+      tm_day.tm_mday++;
+      tm_day.tm_isdst = -1;
+      const auto day_length = mktime(&tm_day) - midnight;
+      const uint32_t expected = !dow_ok ? 0 :
+        sim_timer.type == TIMER_COUNTDOWN_ABS ? (day_length - sim_timer.offset + sim_timer.interval - 1) / sim_timer.interval : 1;
+      if (stats.fires[day] < expected)
+        missed += expected - stats.fires[day];
+      else
+        doubles += stats.fires[day] - expected;
+    }
+    fires_total += fires;
+    anomalies_total += missed + doubles;
+    if (sim_log && id <= SIM_TIMERS_NUM)
+      printf("%3d  %-14s %5u %6u %6u %s\n", id, describe(sim_timer).c_str(), fires, missed, doubles, sim_timer.action);
+  }
+  printf("%u firings, %u anomalies\n", fires_total, anomalies_total);
+  return anomalies_total;
+}
+
+// Program entry point
+int main(int argc, char *argv[]) {
+  int year = 0;
+  const char *tz = nullptr;
+  uint16_t copies = 1;
+  auto fast_forward = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "y:z:n:fqv")) != -1)
+    switch (opt) {
+      case 'y': year = atoi(optarg);                 break;
+      case 'z': tz = optarg;                         break;
+      case 'n': copies = atoi(optarg);               break;
+      case 'f': fast_forward = true;                 break;
+      case 'q': sim_log = false;                     break;
+      case 'v': Serial.setStream(stdout);            break;
+      default:
+        fprintf(stderr, "Usage: %s [-y year] [-z timezone] [-n copies] [-f] [-q] [-v]\n", argv[0]);
+        return 2;
+    }
+  if (!copies || copies * SIM_TIMERS_NUM > DS_TIMERS_MAX) {
+    fprintf(stderr, "Invalid number of copies (timer table holds %u timers)\n", DS_TIMERS_MAX);
+    return 2;
+  }
+
+  System::begin();
+  if (tz)
+    setTZ(tz);
+
+  // Replay from January 1 to January 1, local time
+  struct tm tm_start = {};
+  if (!year) {
+    const auto now = ::time(nullptr);
+    year = localtime(&now)->tm_year + 1900;
+  }
+  tm_start.tm_year = year - 1900;
+  tm_start.tm_mday = 1;
+  tm_start.tm_isdst = -1;
+  sim_start = mktime(&tm_start);
+  tm_start.tm_year++;
+  tm_start.tm_isdst = -1;
+  const auto sim_end = mktime(&tm_start);
+  const uint16_t days = (sim_end - sim_start + 12 * 60 * 60) / (24 * 60 * 60);
+
+  sim_time = sim_start - 1;
+  System::update();                        // Set the system clock
+  System::setTimeSyncTime(sim_time);
+  System::setTimeSyncStatus(TIME_SYNC_OK);
+
+  for (uint8_t i = 0; i < SIM_TIMERS_NUM; i++)
+    System::addTimerAction(SIM_TIMERS[i].action, simFire);
+  sim_stats.resize(copies * SIM_TIMERS_NUM + 1, {std::vector<uint8_t>(days + 1)});
+  for (uint16_t copy = 0; copy < copies; copy++)
+    for (uint8_t i = 0; i < SIM_TIMERS_NUM; i++)
+      System::addTimer(createTimer(SIM_TIMERS[i], copy * SIM_TIMERS_NUM + i + 1));
+
+  printf("Replaying %d (%u days, %s) with %u timer(s)%s\n", year, days, tz ? tz : DS_TIMEZONE, copies * SIM_TIMERS_NUM,
+    fast_forward ? ", fast-forwarding idle periods" : "");
+
+  // Main loop. Each call to update() sees a new second
+  uint64_t updates = 0;
+  const auto wall_start = std::chrono::steady_clock::now();
+  while (sim_time < sim_end) {
+    auto next = sim_time + 1;
+    if (fast_forward) {
+      const auto next_timer = System::getNextTimerTime();
+      if (next_timer > next)
+        next = next_timer - 1;             // Land just before the timer, so that it is processed in the following second
+    }
+    sim_time = next < sim_end ? next : sim_end;
+    System::update();
+    updates++;
+  }
+  System::update();                        // Process the last second
+  const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_start;
+
+  const auto anomalies = report(copies, days);
+  const double sim_seconds = sim_end - sim_start;
+  printf("Replayed %.0f s in %.3f s: %llu updates, %.3g simulated s/s, %.3g timer evaluations/s\n",
+    sim_seconds, wall.count(), (unsigned long long)updates, sim_seconds / wall.count(),
+    sim_seconds * copies * SIM_TIMERS_NUM / wall.count());
+  return anomalies ? 1 : 0;
+}
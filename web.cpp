@@ -5,6 +5,7 @@
 
 #include "MySystem.h"                      // System-level definitions
 #include "BulbManager.h"                   // Bulb manager
+#include "Sequencer.h"                     // Macro sequencer
 
 using namespace ds;
 
@@ -27,6 +28,7 @@ static void pushHeader(const String& title, bool redirect = false) {
     "<table cellpadding=\"0\" cellspacing=\"0\" width=\"100%\"><tr><td>"
     "[&nbsp;<a href=\"/\">home</a>&nbsp;]&nbsp;&nbsp;&nbsp;"
     "[&nbsp;<a href=\"/conf\">config</a>&nbsp;]&nbsp;&nbsp;&nbsp;"
+    "[&nbsp;<a href=\"/groups\">groups</a>&nbsp;]&nbsp;&nbsp;&nbsp;"
     "[&nbsp;<a href=\"/timers\">timers</a>&nbsp;]&nbsp;&nbsp;&nbsp;"
     "[&nbsp;<a href=\"/log\">log</a>&nbsp;]<br/>"
     "[&nbsp;<a href=\"/about\">about</a>&nbsp;]&nbsp;&nbsp;&nbsp;"
@@ -46,27 +48,62 @@ static void pushFooter() {
 }
 
 
+// Queue light adjustment from web arguments (bright=1..100, ct=1700..6500, rgb=RRGGBB). Returns true if any was found
+static bool processLightArgs() {
+  auto &ws = System::web_server;
+  const String group = ws.arg("group");
+  auto found = false;
+  if (ws.hasArg("bright")) {
+    bulb_manager.setLight(YL_PROP_BRIGHT, ws.arg("bright").toInt(), group);
+    found = true;
+  }
+  if (ws.hasArg("ct")) {
+    bulb_manager.setLight(YL_PROP_CT, ws.arg("ct").toInt(), group);
+    found = true;
+  }
+  if (ws.hasArg("rgb")) {
+    auto rgb = ws.arg("rgb");
+    if (rgb.startsWith("#"))
+      rgb.remove(0, 1);
+    bulb_manager.setLight(YL_PROP_RGB, strtoul(rgb.c_str(), nullptr, 16), group);
+    found = true;
+  }
+  return found;
+}
+
 // Root page. Show status
 void handleRoot() {
   auto &page = System::web_page;
 
   // Execute command, if any
   if (System::web_server.args() > 0) {
+    const String group = System::web_server.arg("group");   // Optional command target
     for (unsigned int i = 0; i < (unsigned int)System::web_server.args(); i++) {
       const String cmd = System::web_server.argName(i);
+      if (cmd == "group" || cmd == "bright" || cmd == "ct" || cmd == "rgb")
+        continue;
       String reason(F("Web page command \""));
       reason += cmd;
       reason += F("\" received from ");
       reason += System::web_server.client().remoteIP().toString();
       if (cmd == "on")
-        bulb_manager.processEvent(BulbManager::EVENT_ON, reason);
+        bulb_manager.processEvent(BulbManager::EVENT_ON, reason, group);
       else if (cmd == "off")
-        bulb_manager.processEvent(BulbManager::EVENT_OFF, reason);
+        bulb_manager.processEvent(BulbManager::EVENT_OFF, reason, group);
       else if (cmd == "flip")
-        bulb_manager.processEvent(BulbManager::EVENT_FLIP, reason);
+        bulb_manager.processEvent(BulbManager::EVENT_FLIP, reason, group);
+      else if (cmd == "sleep")
+        bulb_manager.delayOff(constrain(System::web_server.arg(i).toInt(), 0L, (long)UINT16_MAX), reason, group);   // Too large values are rejected rather than wrapped
+      else if (cmd == "restore")
+        bulb_manager.restoreSnapshot(System::web_server.arg(i), reason);
+      else if (cmd == "macro")
+        sequencer.start(System::web_server.arg(i), reason);
+      else if (cmd == "scene")
+        bulb_manager.processEvent(BulbManager::EVENT_SCENE, reason, System::web_server.arg(i));
       else
         System::log->printf(TIMED("Invalid command: '%s', ignoring\n"), cmd.c_str());
     }
+    processLightArgs();
   }
 
   pushHeader(F("Yeelight Button"));
@@ -89,6 +126,23 @@ void handleRoot() {
 
   page += F("\n</p>\n");
 
+  // Light controls. Slider movements are sent in the background; the switch coalesces them
+  const auto leader = bulb_manager.getLeader();
+  if (leader) {
+    char rgb[8];
+    snprintf(rgb, sizeof(rgb), "#%06x", leader->getRGB());
+    page += F("<script>function light(p,v){fetch('/light?'+p+'='+encodeURIComponent(v));}</script>\n"
+      "<table>\n<tr><td>Brightness</td><td><input type=\"range\" min=\"1\" max=\"100\" value=\"");
+    page += leader->getBright() ? leader->getBright() : 100;
+    page += F("\" oninput=\"light('bright',this.value)\"/></td></tr>\n"
+      "<tr><td>Temperature</td><td><input type=\"range\" min=\"1700\" max=\"6500\" step=\"100\" value=\"");
+    page += leader->getCT() ? leader->getCT() : 4000;
+    page += F("\" oninput=\"light('ct',this.value)\"/></td></tr>\n"
+      "<tr><td>Color</td><td><input type=\"color\" value=\"");
+    page += rgb;
+    page += F("\" oninput=\"light('rgb',this.value)\"/></td></tr>\n</table>\n");
+  }
+
   // Table of bulbs
   page += F("Linked bulbs:<br/>\n");
   bulb_manager.printStatusHTML(page);
@@ -98,6 +152,12 @@ void handleRoot() {
   System::sendWebPage();
 }
 
+// Light adjustment (lightweight endpoint for interactive controls)
+void handleLight() {
+  const auto ok = processLightArgs();
+  System::web_server.send(ok ? 200 : 400, "text/plain", ok ? F("OK\n") : F("No light arguments\n"));
+}
+
 // Bulb discovery page
 void handleConf() {
   auto &page = System::web_page;
@@ -134,10 +194,10 @@ void handleSave() {
 
   bulb_manager.save();
 
-  const auto nargs = System::web_server.args();
+  const auto nargs = System::web_server.hasArg("bulb");
   const auto linked = bulb_manager.isLinked();
   const auto nabulbs = bulb_manager.getNumActive();
-  pushHeader(String(F("Yeelight Button Configuration")) + linked || !nargs ? F(" Saved") : F(" Error"), true);
+  pushHeader(String(F("Yeelight Button Configuration")) + (linked || !nargs ? F(" Saved") : F(" Error")), true);
   if (nargs) {
     if (linked) {
       page += F("<p>");
@@ -154,11 +214,50 @@ void handleSave() {
   System::sendWebPage();
 }
 
+// Groups and scenes page
+void handleGroups() {
+  auto &page = System::web_page;
+
+  pushHeader(F("Yeelight Button Groups"));
+  page += F("<p>Groups are controlled with <code>/?on&amp;group=&lt;name&gt;</code> (<code>off</code> and <code>flip</code> work similarly); "
+    "scenes with <code>/?scene=&lt;name&gt;</code> or a timer; snapshots with <code>/?restore=&lt;name&gt;</code> or a timer.</p>\n");
+  bulb_manager.printGroupsHTML(page);
+  sequencer.printHTML(page);
+  pushFooter();
+  System::sendWebPage();
+}
+
+// Groups and scenes saving page
+void handleGroupsSave() {
+  auto &page = System::web_page;
+
+  const auto ok = bulb_manager.saveGroups();
+  pushHeader(String(F("Yeelight Button Groups")) + (ok ? F(" Saved") : F(" Error")), true);
+  page += ok ? F("<p>Configuration saved</p>") : F("<p>Invalid or incomplete settings</p>");
+  pushFooter();
+  System::sendWebPage();
+}
+
+// Macros saving page
+void handleMacrosSave() {
+  auto &page = System::web_page;
+
+  const auto ok = sequencer.save();
+  pushHeader(String(F("Yeelight Button Macros")) + (ok ? F(" Saved") : F(" Error")), true);
+  page += ok ? F("<p>Configuration saved</p>") : F("<p>Invalid or incomplete settings</p>");
+  pushFooter();
+  System::sendWebPage();
+}
+
 // Activate web pages
 void registerPages() {
-  System::web_server.on("/",     handleRoot);
-  System::web_server.on("/conf", handleConf);
-  System::web_server.on("/save", handleSave);
+  System::web_server.on("/",            handleRoot);
+  System::web_server.on("/light",       handleLight);
+  System::web_server.on("/conf",        handleConf);
+  System::web_server.on("/save",        handleSave);
+  System::web_server.on("/groups",      handleGroups);
+  System::web_server.on("/groups-save", handleGroupsSave);
+  System::web_server.on("/macros-save", handleMacrosSave);
 }
 
 // Install handler